@@ -0,0 +1,614 @@
+// uwu-bench: headless timings for the player's hot paths. Links the same
+// libuwu.a as the player, never touches ncurses or PipeWire, and
+// generates its own fixtures in a temporary directory.
+//
+//   UWU_BENCH_SECONDS  minimum time per benchmark (default 0.5)
+//   UWU_BENCH_FILTER   only run benchmarks whose name contains this
+//   UWU_BENCH_LIBRARY  also scan and tag a real music directory
+//
+// Allocations are counted at operator new, so they cover the C++ side
+// (strings, vectors, TagLib) but not malloc() inside the C libraries.
+
+#include "library.h"
+#include "engine.h"
+#include "loudness.h"
+#include "online.h"
+#include "queue.h"
+#include "visualizer.h"
+#include "ui.h"
+
+#include <new>
+#include <cstdlib>
+
+extern "C" {
+#include <libavutil/log.h>
+}
+
+#include <taglib/mpegfile.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/attachedpictureframe.h>
+
+// --- Allocation Counting ---
+
+static std::atomic<uint64_t> g_alloc_count{0};
+static std::atomic<uint64_t> g_alloc_bytes{0};
+
+static void* counted_alloc(size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+static void* counted_alloc(size_t size, std::align_val_t align) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    size_t a = std::max(sizeof(void*), static_cast<size_t>(align));
+    void* p = nullptr;
+    return posix_memalign(&p, a, size ? size : 1) == 0 ? p : nullptr;
+}
+
+void* operator new(size_t size) {
+    if (void* p = counted_alloc(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+    if (void* p = counted_alloc(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, std::align_val_t align) {
+    if (void* p = counted_alloc(size, align)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size, std::align_val_t align) {
+    if (void* p = counted_alloc(size, align)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+// GCC flags free() on memory from operator new once these inline into
+// callers, but the replacements above allocate with malloc
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { free(p); }
+
+// --- Runner ---
+
+double bench_seconds = 0.5;
+std::string bench_filter;
+
+// `units` is what one op processes (frames, files) for the rate column
+void run_bench(const std::string& name, const std::function<void()>& op,
+               double units = 0, const char* unit = nullptr) {
+    if (!bench_filter.empty() && name.find(bench_filter) == std::string::npos) return;
+
+    op(); // warm caches and lazy state before timing
+
+    uint64_t iterations = 0;
+    uint64_t batch = 1;
+    double elapsed = 0;
+    uint64_t allocs = 0;
+    uint64_t bytes = 0;
+    while (elapsed < bench_seconds) {
+        uint64_t allocs_before = g_alloc_count.load(std::memory_order_relaxed);
+        uint64_t bytes_before = g_alloc_bytes.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < batch; ++i) op();
+        elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        allocs += g_alloc_count.load(std::memory_order_relaxed) - allocs_before;
+        bytes += g_alloc_bytes.load(std::memory_order_relaxed) - bytes_before;
+        iterations += batch;
+        batch = std::min<uint64_t>(batch * 2, 1 << 20);
+    }
+
+    double ns_per_op = elapsed * 1e9 / iterations;
+    printf("%-28s %10llu %14.1f %11.2f %12.0f", name.c_str(),
+           static_cast<unsigned long long>(iterations), ns_per_op,
+           double(allocs) / iterations, double(bytes) / iterations);
+    if (unit && units > 0) {
+        printf("  %.3g %s/s", units * 1e9 / ns_per_op, unit);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+void skip_bench(const std::string& name, const char* why) {
+    if (!bench_filter.empty() && name.find(bench_filter) == std::string::npos) return;
+    printf("%-28s skipped: %s\n", name.c_str(), why);
+}
+
+// --- Fixtures ---
+
+const int FIXTURE_SECONDS = 30;
+const int COVER_SIZE = 1000;
+
+struct AudioFixture {
+    const char* name;
+    int format;
+    int rate;
+    std::string path;
+};
+
+// A stereo tone with a little movement so lossy encoders have work to do
+bool write_audio_fixture(const std::string& path, int format, int rate, int seconds) {
+    SF_INFO info{};
+    info.samplerate = rate;
+    info.channels = 2;
+    info.format = format;
+    if (!sf_format_check(&info)) return false;
+
+    SNDFILE* file = sf_open(path.c_str(), SFM_WRITE, &info);
+    if (!file) return false;
+    sf_set_string(file, SF_STR_TITLE, "Bench Tone");
+    sf_set_string(file, SF_STR_ARTIST, "uwu-bench");
+    sf_set_string(file, SF_STR_ALBUM, "Fixtures");
+
+    std::vector<float> chunk(static_cast<size_t>(DECODE_CHUNK_FRAMES) * 2);
+    sf_count_t total = static_cast<sf_count_t>(rate) * seconds;
+    double phase = 0;
+    for (sf_count_t done = 0; done < total;) {
+        sf_count_t n = std::min<sf_count_t>(DECODE_CHUNK_FRAMES, total - done);
+        for (sf_count_t i = 0; i < n; ++i) {
+            double t = double(done + i) / rate;
+            phase += 2 * M_PI * (440.0 + 110.0 * sin(2 * M_PI * 0.5 * t)) / rate;
+            chunk[i * 2] = static_cast<float>(0.4 * sin(phase));
+            chunk[i * 2 + 1] = static_cast<float>(0.4 * sin(phase * 1.5));
+        }
+        if (sf_writef_float(file, chunk.data(), n) != n) {
+            sf_close(file);
+            return false;
+        }
+        done += n;
+    }
+    return sf_close(file) == 0;
+}
+
+// A gradient with some texture, encoded the way covers usually ship
+std::vector<char> encode_cover(AVCodecID id, int size) {
+    std::vector<char> out;
+    const AVCodec* codec = avcodec_find_encoder(id);
+    if (!codec) return out;
+
+    AVCodecContext* ctx = avcodec_alloc_context3(codec);
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* packet = av_packet_alloc();
+    if (ctx && frame && packet) {
+        ctx->width = size;
+        ctx->height = size;
+        ctx->time_base = AVRational{1, 25};
+        ctx->pix_fmt = id == AV_CODEC_ID_MJPEG ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_RGB24;
+        frame->format = ctx->pix_fmt;
+        frame->width = size;
+        frame->height = size;
+
+        if (avcodec_open2(ctx, codec, nullptr) == 0 && av_frame_get_buffer(frame, 0) == 0) {
+            auto texture = [](int x, int y) { return ((x * 7 + y * 13) ^ (x * y)) & 31; };
+            if (ctx->pix_fmt == AV_PIX_FMT_RGB24) {
+                for (int y = 0; y < size; ++y) {
+                    uint8_t* row = frame->data[0] + y * frame->linesize[0];
+                    for (int x = 0; x < size; ++x) {
+                        row[x * 3] = static_cast<uint8_t>(x * 224 / size + texture(x, y));
+                        row[x * 3 + 1] = static_cast<uint8_t>(y * 224 / size + texture(y, x));
+                        row[x * 3 + 2] = static_cast<uint8_t>((x + y) * 112 / size);
+                    }
+                }
+            } else {
+                for (int y = 0; y < size; ++y) {
+                    uint8_t* row = frame->data[0] + y * frame->linesize[0];
+                    for (int x = 0; x < size; ++x) {
+                        row[x] = static_cast<uint8_t>((x + y) * 112 / size + texture(x, y));
+                    }
+                }
+                for (int y = 0; y < size / 2; ++y) {
+                    uint8_t* u = frame->data[1] + y * frame->linesize[1];
+                    uint8_t* v = frame->data[2] + y * frame->linesize[2];
+                    for (int x = 0; x < size / 2; ++x) {
+                        u[x] = static_cast<uint8_t>(64 + x * 128 / size);
+                        v[x] = static_cast<uint8_t>(192 - y * 128 / size);
+                    }
+                }
+            }
+            if (avcodec_send_frame(ctx, frame) == 0 && avcodec_send_frame(ctx, nullptr) == 0 &&
+                avcodec_receive_packet(ctx, packet) == 0) {
+                out.assign(reinterpret_cast<const char*>(packet->data),
+                           reinterpret_cast<const char*>(packet->data) + packet->size);
+            }
+        }
+    }
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    return out;
+}
+
+bool attach_cover(const std::string& mp3_path, const std::vector<char>& jpeg) {
+    TagLib::MPEG::File file(mp3_path.c_str());
+    if (!file.isValid() || jpeg.empty()) return false;
+    auto* picture = new TagLib::ID3v2::AttachedPictureFrame;
+    picture->setMimeType("image/jpeg");
+    picture->setType(TagLib::ID3v2::AttachedPictureFrame::FrontCover);
+    picture->setPicture(TagLib::ByteVector(jpeg.data(), static_cast<unsigned int>(jpeg.size())));
+    file.ID3v2Tag(true)->addFrame(picture);
+    return file.save();
+}
+
+// dirs × files_per_dir hard links to one short track
+size_t build_scan_tree(const std::string& root, const std::string& track, int dirs, int files_per_dir) {
+    size_t made = 0;
+    std::error_code ec;
+    for (int d = 0; d < dirs; ++d) {
+        std::string dir = root + "/artist-" + std::to_string(d / 10) + "/album-" + std::to_string(d);
+        fs::create_directories(dir, ec);
+        for (int f = 0; f < files_per_dir; ++f) {
+            std::string path = dir + "/" + std::to_string(f) + " - track.wav";
+            if (link(track.c_str(), path.c_str()) == 0) ++made;
+        }
+    }
+    return made;
+}
+
+// --- Benchmarks ---
+
+void bench_decode(const AudioFixture& fixture) {
+    std::string name = std::string("read/") + fixture.name;
+    std::unique_ptr<AudioSource> source = open_audio_source(fixture.path);
+    if (!source) {
+        skip_bench(name, "could not open fixture");
+        return;
+    }
+    std::vector<float> buffer(static_cast<size_t>(DECODE_CHUNK_FRAMES) * source->channels());
+    run_bench(name, [&] {
+        if (source->read(buffer.data(), DECODE_CHUNK_FRAMES) < DECODE_CHUNK_FRAMES &&
+            !source->seek(0)) {
+            source = open_audio_source(fixture.path);
+        }
+    }, DECODE_CHUNK_FRAMES, "frame");
+}
+
+void bench_art(const std::string& label, const std::vector<char>& cover) {
+    std::string name = "art/" + label;
+    if (cover.empty()) {
+        skip_bench(name, "no encoder for fixture");
+        return;
+    }
+    // The uncached path: decode, downscale, quantize, build both forms
+    run_bench(name, [&] {
+        int width = 0, height = 0;
+        std::vector<uint8_t> rgb;
+        if (decodeCoverImage(cover.data(), cover.size(), width, height, rgb)) {
+            renderAlbumArt(rgb, width, height);
+        }
+    });
+}
+
+void bench_tags(const std::string& name, const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        skip_bench(name, "fixture missing");
+        return;
+    }
+    run_bench(name, [&] { readLibraryTrack(path, st); }, 1, "file");
+}
+
+void bench_scan(const std::string& label, const std::string& root, const std::string& cache_dir) {
+    // A full walk with no index on disk; returns the files seen
+    auto cold_scan = [&] {
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(cache_dir, ec)) {
+            if (entry.path().filename().string().rfind("library-", 0) == 0) fs::remove(entry.path(), ec);
+        }
+        LibraryIndex index(root, cache_dir);
+        index.open();
+        index.start_rescan();
+        while (index.scanning()) std::this_thread::sleep_for(std::chrono::microseconds(200));
+        return index.files_scanned();
+    };
+
+    size_t files = cold_scan();
+    if (files == 0) {
+        skip_bench("scan/" + label, "no audio files found");
+        return;
+    }
+    run_bench("scan/" + label + "-cold", [&] { cold_scan(); }, double(files), "file");
+
+    // Startup against an up-to-date index: map, stat sweep, visit tracks
+    run_bench("scan/" + label + "-warm", [&] {
+        LibraryIndex index(root, cache_dir);
+        index.open();
+        size_t seen = 0;
+        index.for_each_fresh_track([&](const LibraryTrackView&) { ++seen; });
+    }, double(files), "file");
+}
+
+void bench_search_parser() {
+    const std::string flat =
+        R"({"_type": "url", "ie_key": "Youtube", "id": "dQw4w9WgXcQ", )"
+        R"("url": "https://www.youtube.com/watch?v=dQw4w9WgXcQ", )"
+        R"("title": "Rick Astley - Never Gonna Give You Up [Official Music Video]", )"
+        R"("description": null, "duration": 212.0, "channel_id": "UCuAXFkgsw1L7xaCfnd5JJOw", )"
+        R"("channel": "Rick Astley", "channel_url": "https://www.youtube.com/channel/UCuAXFkgsw1L7xaCfnd5JJOw", )"
+        R"("uploader": "Rick Astley", "view_count": 1500000000, "live_status": null})";
+
+    std::string full = flat;
+    full.pop_back();
+    full += R"(, "thumbnails": [)";
+    for (int i = 0; i < 8; ++i) {
+        if (i) full += ", ";
+        full += R"({"url": "https://i.ytimg.com/vi/dQw4w9WgXcQ/hq)" + std::to_string(i) +
+                R"(.jpg?sqp=-oaymwEbCKgBEF5IVfKriqkDDggBFQAAiEIYAXABwAEG&rs=AOn4CLB", )"
+                R"("height": 94, "width": 168, "id": ")" + std::to_string(i) + R"("})";
+    }
+    full += R"(], "tags": ["rick astley", "never gonna give you up", "80s"], )"
+            R"("chapters": null, "__x_forwarded_for_ip": null, "epoch": 1700000000})";
+
+    run_bench("search/parse-flat", [&] {
+        SearchResult result;
+        parse_search_result(flat, result);
+    }, 1, "line");
+    run_bench("search/parse-full", [&] {
+        SearchResult result;
+        parse_search_result(full, result);
+    }, 1, "line");
+}
+
+// One steady-state frame of the library player's data side: cache hits
+// for the rows around the cursor, then the Now Playing text and the
+// telemetry overlay rebuilt in place. All three should show 0 allocs/op.
+void bench_frame(const std::vector<std::string>& paths) {
+    if (paths.empty()) {
+        skip_bench("frame/meta-window", "no fixtures");
+        return;
+    }
+
+    MetadataCache cache;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    for (const std::string& path : paths) {
+        std::shared_ptr<const TrackMeta> meta;
+        while (!(meta = cache.lookup(path)) || !meta->art_loaded) {
+            if (std::chrono::steady_clock::now() > deadline) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    run_bench("frame/meta-window", [&] {
+        for (size_t i = 0; i < 11; ++i) cache.prefetch(paths[i % paths.size()]);
+        cache.lookup(paths[0]);
+    });
+
+    PlaybackFrame frame;
+    std::shared_ptr<const TrackMeta> meta = cache.lookup(paths[0]);
+    run_bench("frame/describe-playback", [&] { describe_playback(frame, meta); });
+
+    AudioTelemetry::Snapshot snapshot;
+    snapshot.callbacks = 123456;
+    snapshot.quantum = 1024;
+    for (int i = 4; i < 12; ++i) snapshot.histogram[i] = 1000 >> (i - 4);
+    run_bench("frame/telemetry-overlay", [&] { telemetry_overlay(snapshot, 48000, frame.telemetry); });
+}
+
+// Keystroke latency of the library filter, worker handoff included.
+// The two queries share no prefix, so neither refines the other.
+void bench_library_search() {
+    const std::string name = "search/filter-200k";
+    if (!bench_filter.empty() && name.find(bench_filter) == std::string::npos) return;
+
+    const size_t tracks = 200000;
+    const char* syllables[] = {"ka", "lo", "mi", "ne", "ru", "sa", "ti", "vo", "be", "da",
+                               "fe", "go", "hu", "ja", "xi", "ze", "qu", "pa", "or", "en"};
+    uint32_t seed = 1;
+    auto word = [&] {
+        std::string w;
+        for (int n = 2 + seed % 3; n > 0; --n) {
+            seed = seed * 1664525 + 1013904223;
+            w += syllables[(seed >> 16) % 20];
+        }
+        return w;
+    };
+
+    LibrarySearch search(nullptr);
+    for (size_t i = 0; i < tracks; ++i) {
+        std::string title = word() + " " + word();
+        std::string artist = word() + " " + word();
+        std::string album = word();
+        search.add(title, artist, album, "/home/user/Music/" + artist + "/" + album + "/" + title + ".flac");
+    }
+
+    std::vector<uint32_t> ids;
+    std::string query;
+    auto ask = [&](const char* q) {
+        search.submit(q);
+        while (!search.take_results(ids, query)) std::this_thread::yield();
+    };
+    ask("warm"); // the first query waits for the index build
+
+    run_bench(name, [&] {
+        ask("mihu");
+        ask("quda");
+    }, 2, "query");
+}
+
+void bench_queue(const std::string& work) {
+    const size_t entries = 100000;
+    PlayQueue queue;
+    std::vector<std::string> paths;
+    paths.reserve(entries);
+    for (size_t i = 0; i < entries; ++i) {
+        paths.push_back("/home/user/Music/Artist " + std::to_string(i / 200) + "/Album/" +
+                        std::to_string(i % 200) + " - Track.flac");
+    }
+
+    auto fill = [&] {
+        queue.clear();
+        for (const std::string& path : paths) queue.append(path);
+    };
+    run_bench("queue/fill-100k", fill, double(entries), "entry");
+    fill(); // the filter may have skipped the line above
+
+    // Remove the current entry and put its successor back at the end:
+    // the size stays put while every link changes hands
+    queue.set_current(queue.first());
+    run_bench("queue/remove-append", [&] {
+        std::string path = queue.path(queue.current());
+        PlayQueue::Id following = queue.successor();
+        queue.remove(queue.current());
+        queue.append(std::move(path));
+        queue.set_current(following);
+    }, 1, "op");
+    run_bench("queue/shuffle-on-100k", [&] {
+        queue.set_shuffle(false);
+        queue.set_shuffle(true);
+    }, double(entries), "entry");
+
+    std::string file = work + "/queue.bin";
+    PlayQueueResume resume;
+    run_bench("queue/save-100k", [&] { queue.save(file, resume); }, double(entries), "entry");
+    PlayQueue loaded;
+    run_bench("queue/load-100k", [&] { loaded.load(file, resume); }, double(entries), "entry");
+}
+
+// Per-buffer cost on the decoder thread, and a whole-file scan
+void bench_loudness(const std::vector<AudioFixture>& fixtures) {
+    const size_t frames = DECODE_CHUNK_FRAMES;
+    std::vector<float> tone(frames * 2);
+    for (size_t i = 0; i < frames; ++i) {
+        tone[i * 2] = tone[i * 2 + 1] = 0.9f * std::sin(static_cast<float>(i) * 0.0627f);
+    }
+    // A boost runs the limiter; a cut is only scaled
+    std::vector<float> buffer = tone;
+    run_bench("loudness/gain-boost", [&] {
+        memcpy(buffer.data(), tone.data(), tone.size() * sizeof(float));
+        apply_gain_limited(buffer.data(), buffer.size(), 1.6f);
+    }, double(frames), "frame");
+    run_bench("loudness/gain-cut", [&] {
+        memcpy(buffer.data(), tone.data(), tone.size() * sizeof(float));
+        apply_gain_limited(buffer.data(), buffer.size(), 0.5f);
+    }, double(frames), "frame");
+
+    LoudnessMeter meter(44100, 2);
+    run_bench("loudness/meter", [&] { meter.add(tone.data(), frames); }, double(frames), "frame");
+
+    for (const AudioFixture& fixture : fixtures) {
+        if (fixture.format != (SF_FORMAT_FLAC | SF_FORMAT_PCM_16)) continue;
+        float lufs, peak;
+        run_bench(std::string("loudness/measure-") + fixture.name,
+                  [&] { measure_loudness(fixture.path, lufs, peak); }, FIXTURE_SECONDS, "s-audio");
+    }
+}
+
+// The RT side is only the tap copy; the FFT runs on the analyzer thread
+void bench_spectrum() {
+    std::vector<float> quantum(512 * 2);
+    for (size_t i = 0; i < 512; ++i) {
+        quantum[i * 2] = quantum[i * 2 + 1] = 0.5f * std::sin(static_cast<float>(i) * 0.0627f);
+    }
+    OutputTap tap;
+    run_bench("vis/tap-push-512", [&] { tap.push(quantum.data(), 512, 2); }, 512, "frame");
+
+    std::vector<float> window(SPECTRUM_FFT_SIZE * 2);
+    tap.read_latest(window.data(), SPECTRUM_FFT_SIZE);
+    SpectrumAnalyzer analyzer(g_engine);
+    analyzer.set_bands(60);
+    run_bench("vis/analyze-2048", [&] {
+        analyzer.analyze(window.data(), 512, 48000, 1.0f / 30);
+    }, 1, "frame");
+}
+
+int main() {
+    av_log_set_level(AV_LOG_QUIET);
+
+    if (const char* seconds = getenv("UWU_BENCH_SECONDS")) {
+        bench_seconds = std::max(0.01, atof(seconds));
+    }
+    if (const char* filter = getenv("UWU_BENCH_FILTER")) {
+        bench_filter = filter;
+    }
+    if (const char* mmap = getenv("UWU_MMAP")) {
+        mmap_enabled = atoi(mmap) != 0;
+    }
+
+    char tmpl[] = "/tmp/uwu-bench-XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string work = tmpl;
+
+    std::vector<AudioFixture> fixtures = {
+        {"wav-pcm16", SF_FORMAT_WAV | SF_FORMAT_PCM_16, 44100, work + "/tone-pcm16.wav"},
+        {"wav-float", SF_FORMAT_WAV | SF_FORMAT_FLOAT, 44100, work + "/tone-float.wav"},
+        {"aiff-pcm24", SF_FORMAT_AIFF | SF_FORMAT_PCM_24, 44100, work + "/tone-pcm24.aiff"},
+        {"flac-16", SF_FORMAT_FLAC | SF_FORMAT_PCM_16, 44100, work + "/tone.flac"},
+        {"ogg-vorbis", SF_FORMAT_OGG | SF_FORMAT_VORBIS, 44100, work + "/tone.ogg"},
+        {"opus", SF_FORMAT_OGG | SF_FORMAT_OPUS, 48000, work + "/tone.opus"},
+        {"mp3", SF_FORMAT_MPEG | SF_FORMAT_MPEG_LAYER_III, 44100, work + "/tone.mp3"},
+    };
+
+    fprintf(stderr, "uwu-bench: writing fixtures to %s\n", work.c_str());
+    std::vector<AudioFixture> written;
+    for (AudioFixture& fixture : fixtures) {
+        if (write_audio_fixture(fixture.path, fixture.format, fixture.rate, FIXTURE_SECONDS)) {
+            written.push_back(fixture);
+        } else {
+            skip_bench(std::string("read/") + fixture.name, "libsndfile cannot encode this format");
+        }
+    }
+
+    std::vector<char> jpeg = encode_cover(AV_CODEC_ID_MJPEG, COVER_SIZE);
+    std::vector<char> png = encode_cover(AV_CODEC_ID_PNG, COVER_SIZE);
+    std::string mp3_path = work + "/tone.mp3";
+    bool mp3_has_cover = fs::exists(mp3_path) && attach_cover(mp3_path, jpeg);
+
+    std::string short_track = work + "/short.wav";
+    std::string tree = work + "/library";
+    std::string cache = work + "/cache";
+    fs::create_directories(cache);
+    size_t tree_files = 0;
+    if (write_audio_fixture(short_track, SF_FORMAT_WAV | SF_FORMAT_PCM_16, 44100, 1)) {
+        tree_files = build_scan_tree(tree, short_track, 200, 20);
+    }
+
+    printf("%-28s %10s %14s %11s %12s\n", "benchmark", "iters", "ns/op", "allocs/op", "bytes/op");
+
+    for (const AudioFixture& fixture : written) bench_decode(fixture);
+
+    bench_art("jpeg-1000", jpeg);
+    bench_art("png-1000", png);
+    if (mp3_has_cover) {
+        // TagLib parse and APIC lookup; the rendered art comes from the cache
+        run_bench("art/extract-mp3", [&] { extractAlbumArt(mp3_path); });
+    } else {
+        skip_bench("art/extract-mp3", "no MP3 fixture with a cover");
+    }
+
+    for (const AudioFixture& fixture : written) {
+        bench_tags(std::string("tags/") + fixture.name, fixture.path);
+    }
+
+    if (tree_files > 0) {
+        bench_scan("fixture", tree, cache);
+    } else {
+        skip_bench("scan/fixture", "could not build the fixture tree");
+    }
+    if (const char* library = getenv("UWU_BENCH_LIBRARY")) {
+        bench_scan("library", library, cache);
+    }
+
+    std::vector<std::string> fixture_paths;
+    for (const AudioFixture& fixture : written) fixture_paths.push_back(fixture.path);
+    bench_frame(fixture_paths);
+    bench_loudness(written);
+    bench_spectrum();
+
+    bench_search_parser();
+    bench_library_search();
+    bench_queue(work);
+
+    std::error_code ec;
+    fs::remove_all(work, ec);
+    return 0;
+}
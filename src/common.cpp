@@ -0,0 +1,22 @@
+#include "common.h"
+
+int64_t stat_mtime_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+uint64_t fnv1a_64(const std::string& s) {
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+std::string cache_directory() {
+    const char* home = getenv("HOME");
+    std::string dir = std::string(home ? home : "/tmp") + "/.tui_player_cache";
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    return dir;
+}
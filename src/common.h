@@ -0,0 +1,39 @@
+#pragma once
+// Standard headers and small helpers shared by every module
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <deque>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <array>
+#include <memory>
+#include <cstdio>
+#include <string_view>
+#include <numeric>
+#include <cmath>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>    // for unlink
+
+namespace fs = std::filesystem;
+
+// Modification time in nanoseconds, as stored in the library index
+int64_t stat_mtime_ns(const struct stat& st);
+
+// Stable across runs and builds, unlike std::hash
+uint64_t fnv1a_64(const std::string& s);
+
+// Shared cache directory for the library index and online downloads
+std::string cache_directory();
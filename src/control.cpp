@@ -0,0 +1,361 @@
+#include "control.h"
+
+#include "engine.h"
+#include "events.h"
+#include "library.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+ControlServer g_control;
+
+std::string default_control_socket_path() {
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime) return std::string(runtime) + "/uwu.sock";
+    return cache_directory() + "/uwu.sock";
+}
+
+bool ControlServer::open(const std::string& path) {
+    close();
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    // A socket that still accepts belongs to another running player
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        bool live = connect(probe, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+        ::close(probe);
+        if (live) return false;
+    }
+    unlink(path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) return false;
+
+    // Owner-only: anyone who can connect can drive the player
+    mode_t old_mask = umask(0177);
+    bool bound = bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+    umask(old_mask);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    if (!bound || listen(listen_fd, 8) != 0 || epoll_fd < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) != 0) {
+        if (bound) unlink(path.c_str());
+        close();
+        return false;
+    }
+    socket_path = path;
+    return true;
+}
+
+void ControlServer::close() {
+    for (auto& entry : clients) ::close(entry.first);
+    clients.clear();
+    if (listen_fd >= 0) ::close(listen_fd);
+    if (epoll_fd >= 0) ::close(epoll_fd);
+    listen_fd = -1;
+    epoll_fd = -1;
+    if (!socket_path.empty()) unlink(socket_path.c_str());
+    socket_path.clear();
+}
+
+void ControlServer::service() {
+    if (epoll_fd < 0) return;
+
+    struct epoll_event events[16];
+    int n = epoll_wait(epoll_fd, events, 16, 0);
+    for (int i = 0; i < n; ++i) {
+        int fd = events[i].data.fd;
+        if (fd == listen_fd) {
+            int conn;
+            while ((conn = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                if (clients.size() >= CONTROL_MAX_CLIENTS) {
+                    ::close(conn);
+                    continue;
+                }
+                struct epoll_event ev = {};
+                ev.events = EPOLLIN;
+                ev.data.fd = conn;
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn, &ev);
+                clients[conn].fd = conn;
+            }
+            continue;
+        }
+
+        auto it = clients.find(fd);
+        if (it == clients.end()) continue;
+        if (events[i].events & EPOLLOUT) flush(it->second);
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) read_from(it->second);
+    }
+
+    for (auto it = clients.begin(); it != clients.end();) {
+        if (it->second.closing) {
+            ::close(it->first); // also leaves the epoll set
+            it = clients.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ControlServer::read_from(Client& client) {
+    char buf[4096];
+    while (!client.closing) {
+        ssize_t got = read(client.fd, buf, sizeof(buf));
+        if (got > 0) {
+            client.in.append(buf, static_cast<size_t>(got));
+        } else if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else if (got < 0 && errno == EINTR) {
+            continue;
+        } else {
+            client.closing = true; // EOF: replies already queued are dropped
+            return;
+        }
+    }
+
+    size_t start = 0;
+    size_t newline;
+    while (!client.closing && (newline = client.in.find('\n', start)) != std::string::npos) {
+        size_t end = newline;
+        if (end > start && client.in[end - 1] == '\r') --end;
+        std::string line = client.in.substr(start, end - start);
+        start = newline + 1;
+        if (!line.empty()) send(client, handle(client, line));
+    }
+    client.in.erase(0, start);
+
+    if (client.in.size() > CONTROL_MAX_LINE) {
+        send(client, "err line too long");
+        client.closing = true;
+    }
+}
+
+void ControlServer::send(Client& client, const std::string& line) {
+    if (client.closing) return;
+    client.out += line;
+    client.out += '\n';
+    flush(client);
+}
+
+void ControlServer::flush(Client& client) {
+    while (!client.out.empty()) {
+        ssize_t sent = ::send(client.fd, client.out.data(), client.out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent > 0) {
+            client.out.erase(0, static_cast<size_t>(sent));
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            client.closing = true;
+            return;
+        }
+    }
+
+    if (client.out.size() > CONTROL_MAX_BACKLOG) {
+        client.closing = true;
+        return;
+    }
+
+    // Only ask for EPOLLOUT while there is a backlog
+    bool want = !client.out.empty();
+    if (want != client.writable_wait) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+        ev.data.fd = client.fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client.fd, &ev);
+        client.writable_wait = want;
+    }
+}
+
+static const char* playback_state() {
+    if (!is_playing) return "stopped";
+    return is_paused ? "paused" : "playing";
+}
+
+std::string ControlServer::status_fields() const {
+    int rate = g_engine.sample_rate();
+    double pos = rate > 0 ? static_cast<double>(current_frame) / rate : 0.0;
+    double len = rate > 0 ? static_cast<double>(total_frames) / rate : 0.0;
+    size_t queued = transport && transport->queued ? transport->queued() : 0;
+    std::string path = is_playing && transport && transport->current ? transport->current() : std::string();
+
+    char fields[128];
+    snprintf(fields, sizeof(fields), "state=%s pos=%.2f len=%.2f queued=%zu path=",
+             playback_state(), pos, len, queued);
+    return fields + path;
+}
+
+std::string ControlServer::handle(Client& client, const std::string& line) {
+    size_t space = line.find(' ');
+    std::string verb = line.substr(0, space);
+    std::string arg;
+    if (space != std::string::npos) {
+        size_t first = line.find_first_not_of(' ', space);
+        if (first != std::string::npos) arg = line.substr(first);
+    }
+
+    if (verb == "status") return "ok " + status_fields();
+    if (verb == "subscribe") {
+        client.subscribed = true;
+        return "ok";
+    }
+
+    if (verb == "pause" || verb == "toggle") {
+        if (!is_playing) return "err not playing";
+        is_paused = verb == "pause" ? true : !is_paused;
+        return "ok";
+    }
+    if (verb == "seek") {
+        int rate = g_engine.sample_rate();
+        if (!is_playing || rate <= 0) return "err not playing";
+        char* end = nullptr;
+        double seconds = strtod(arg.c_str(), &end);
+        if (arg.empty() || *end != '\0' || !std::isfinite(seconds)) return "err bad position";
+        double base = (arg[0] == '+' || arg[0] == '-') ? static_cast<double>(current_frame) / rate : 0.0;
+        g_engine.seek(std::max<sf_count_t>(0, static_cast<sf_count_t>((base + seconds) * rate)));
+        return "ok";
+    }
+
+    if (verb == "play") {
+        if (arg.empty() && is_playing) {
+            is_paused = false;
+            return "ok";
+        }
+        if (!transport || !transport->play) return "err unsupported";
+        return transport->play(arg) ? "ok" : "err cannot play";
+    }
+    if (verb == "stop") {
+        if (transport && transport->stop) {
+            transport->stop();
+        } else {
+            StopAudio();
+        }
+        return "ok";
+    }
+    if (verb == "next" || verb == "prev") {
+        const std::function<bool()>* step = nullptr;
+        if (transport) step = verb == "next" ? &transport->next : &transport->prev;
+        if (!step || !*step) return "err unsupported";
+        return (*step)() ? "ok" : "err no " + verb + " track";
+    }
+    if (verb == "enqueue") {
+        if (arg.empty()) return "err missing path";
+        if (!transport || !transport->enqueue) return "err unsupported";
+        return transport->enqueue(arg) ? "ok" : "err cannot enqueue";
+    }
+    if (verb == "shuffle") {
+        if (arg != "on" && arg != "off") return "err expected on or off";
+        if (!transport || !transport->shuffle) return "err unsupported";
+        transport->shuffle(arg == "on");
+        return "ok";
+    }
+    if (verb == "repeat") {
+        RepeatMode mode;
+        if (arg == "off") mode = RepeatMode::Off;
+        else if (arg == "all") mode = RepeatMode::All;
+        else if (arg == "one") mode = RepeatMode::One;
+        else return "err expected off, all or one";
+        if (!transport || !transport->repeat) return "err unsupported";
+        transport->repeat(mode);
+        return "ok";
+    }
+    if (verb == "quit") {
+        if (!transport || !transport->quit) return "err unsupported";
+        transport->quit();
+        return "ok";
+    }
+    return "err unknown command";
+}
+
+void ControlServer::publish() {
+    if (clients.empty()) return;
+
+    // Runs before every sleep, so the unchanged case must not allocate
+    const char* state = playback_state();
+    static const std::string no_track;
+    const std::string& track = is_playing && transport && transport->current ? transport->current() : no_track;
+    bool state_changed = state != last_state;
+    bool track_changed = !track.empty() && track != last_track;
+    if (!state_changed && !track_changed) return;
+    last_state = state;
+    if (!track.empty()) last_track = track;
+
+    for (auto& entry : clients) {
+        Client& client = entry.second;
+        if (!client.subscribed) continue;
+        if (track_changed) send(client, "event track " + track);
+        if (state_changed) send(client, std::string("event state ") + state);
+    }
+}
+
+ControlServer::Transport queue_transport(PlayQueue& queue, QueuePlayer& player) {
+    ControlServer::Transport transport;
+    transport.play = [&queue, &player](const std::string& path) {
+        if (path.empty()) {
+            PlayQueue::Id id = queue.current() != PlayQueue::NONE ? queue.current() : queue.successor();
+            return player.play(id != PlayQueue::NONE ? id : queue.first());
+        }
+        return player.play(queue.insert_after(queue.current(), path));
+    };
+    transport.stop = [&player] { player.stop(); };
+    transport.next = [&player] { return player.next(); };
+    transport.prev = [&player] { return player.prev(); };
+    transport.enqueue = [&queue](const std::string& path) {
+        queue.append(path);
+        return true;
+    };
+    transport.current = [&player]() -> const std::string& { return player.playing(); };
+    transport.queued = [&queue] { return queue.size(); };
+    transport.shuffle = [&queue](bool on) { queue.set_shuffle(on); };
+    transport.repeat = [&queue](RepeatMode mode) { queue.set_repeat(mode); };
+    return transport;
+}
+
+// --- Headless Mode ---
+
+void run_headless(const std::vector<std::string>& paths) {
+    PlayQueue queue;
+    QueuePlayer player(queue, default_queue_path());
+
+    if (paths.empty()) {
+        player.resume();
+    }
+    for (const std::string& path : paths) {
+        std::error_code ec;
+        if (!fs::is_directory(path, ec)) {
+            queue.append(path);
+            continue;
+        }
+        std::vector<std::string> found;
+        for (auto it = fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, ec);
+             it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (ec) break;
+            if (it->is_regular_file(ec) && is_audio_file(it->path())) found.push_back(it->path().string());
+        }
+        std::sort(found.begin(), found.end());
+        for (std::string& file : found) queue.append(std::move(file));
+    }
+    if (!paths.empty()) player.play(queue.first());
+
+    bool running = true;
+    ControlServer::Transport transport = queue_transport(queue, player);
+    transport.quit = [&running] { running = false; };
+    ControlServer::Scope scope(g_control, transport);
+
+    while (running) {
+        player.update();
+        if (g_events.wait() & EventLoop::Quit) break;
+    }
+
+    player.save();
+    StopAudio();
+}
@@ -0,0 +1,129 @@
+#pragma once
+// Remote control over a Unix-domain socket, and the headless player
+
+#include "common.h"
+#include "queue.h"
+
+// --- Control Socket ---
+//
+// One command per line; every command gets exactly one reply line, "ok"
+// (plus fields) or "err <reason>". After "subscribe" the client is also
+// sent "event state <playing|paused|stopped>" and "event track <path>"
+// lines as they happen. Numbers are seconds.
+//
+//   status           ok state=<state> pos=<s> len=<s> queued=<n> path=<path>
+//   play [path]      resume, start, or play path now
+//   pause | toggle | stop | next | prev
+//   seek <s> | seek +<s> | seek -<s>
+//   enqueue <path>
+//   shuffle on|off
+//   repeat off|all|one
+//   subscribe
+//   quit             stop the headless player
+//
+// Everything runs on the UI thread from inside EventLoop::wait() and
+// never blocks: a client that stops reading is dropped once its backlog
+// passes CONTROL_MAX_BACKLOG.
+
+const size_t CONTROL_MAX_CLIENTS = 32;
+const size_t CONTROL_MAX_LINE = 4096;
+const size_t CONTROL_MAX_BACKLOG = 64 * 1024;
+
+// $XDG_RUNTIME_DIR/uwu.sock, or the cache directory without one
+// (override with UWU_SOCKET, empty to disable)
+std::string default_control_socket_path();
+
+class ControlServer {
+public:
+    // What the current screen can do beyond pause/seek/status, which act
+    // on the engine directly. Unset members answer "err unsupported".
+    struct Transport {
+        std::function<bool(const std::string& path)> play; // empty: start or resume
+        std::function<void()> stop;
+        std::function<bool()> next;
+        std::function<bool()> prev;
+        std::function<bool(const std::string& path)> enqueue;
+        std::function<const std::string&()> current; // path of the playing track
+        std::function<size_t()> queued;
+        std::function<void(bool on)> shuffle;
+        std::function<void(RepeatMode mode)> repeat;
+        std::function<void()> quit;
+    };
+
+    // Installs a transport for the lifetime of a screen
+    class Scope {
+    public:
+        Scope(ControlServer& server, const Transport& transport)
+            : server(server), previous(server.transport) {
+            server.transport = &transport;
+        }
+        ~Scope() { server.transport = previous; }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        ControlServer& server;
+        const Transport* previous;
+    };
+
+    ControlServer() = default;
+    ~ControlServer() { close(); }
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+
+    // Bind and listen at path, replacing a stale socket file. Fails if
+    // another player still answers there.
+    bool open(const std::string& path);
+    void close();
+
+    // Pollable while any client or the listening socket has activity
+    int fd() const { return epoll_fd; }
+    const std::string& path() const { return socket_path; }
+
+    // Accept, read and answer whatever is ready; never blocks
+    void service();
+
+    // Send subscribers the state and track changes since the last call
+    void publish();
+
+private:
+    struct Client {
+        int fd = -1;
+        std::string in;
+        std::string out;
+        bool subscribed = false;
+        bool writable_wait = false;
+        bool closing = false;
+    };
+
+    std::string handle(Client& client, const std::string& line);
+    std::string status_fields() const;
+    void send(Client& client, const std::string& line);
+    void flush(Client& client);
+    void read_from(Client& client);
+
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    std::string socket_path;
+    std::unordered_map<int, Client> clients;
+    const Transport* transport = nullptr;
+    const char* last_state = nullptr; // one of playback_state()'s literals
+    std::string last_track;
+};
+
+// Global control socket
+extern ControlServer g_control;
+
+// Every verb but quit, backed by a play queue. "play <path>" plays the
+// path next to the current entry; a bare "play" starts the current one.
+ControlServer::Transport queue_transport(PlayQueue& queue, QueuePlayer& player);
+
+// --- Headless Mode ---
+
+// Play files and directories (recursively, in path order) without a
+// terminal, steered only through the control socket, until "quit" or a
+// SIGINT/SIGTERM/SIGHUP. With no paths the saved queue resumes. Needs
+// g_events.init(false).
+void run_headless(const std::vector<std::string>& paths);
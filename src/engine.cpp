@@ -0,0 +1,1462 @@
+#include "engine.h"
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+std::atomic<bool> is_playing(false);
+std::atomic<bool> is_paused(false);
+std::atomic<sf_count_t> total_frames(0);
+std::atomic<sf_count_t> current_frame(0);
+std::atomic<uint64_t> underrun_count(0);
+int ring_buffer_ms = 750;
+int start_buffer_ms = 250;
+bool gapless_enabled = true;
+int output_rate = 48000;
+int output_channels = 2;
+
+// --- Seek Tables ---
+
+SeekTable::SeekTable(const std::string& path, int sample_rate)
+    : rate(static_cast<uint32_t>(sample_rate)),
+      interval(static_cast<int64_t>(sample_rate) * SEEK_TABLE_INTERVAL_MS / 1000) {
+    std::string absolute = fs::absolute(path).lexically_normal().string();
+    char name[32];
+    snprintf(name, sizeof(name), "seek-%016llx.tbl",
+             static_cast<unsigned long long>(fnv1a_64(absolute)));
+    table_path = cache_directory() + "/" + name;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return;
+    file_size = static_cast<uint64_t>(st.st_size);
+    mtime = stat_mtime_ns(st);
+    load();
+}
+
+void SeekTable::add(int64_t frame, int64_t offset) {
+    if (complete || frame < 0 || offset < 0) return;
+    if (!points.empty() && (frame < points.back().frame + interval || offset <= points.back().offset)) {
+        return;
+    }
+    points.push_back({frame, offset});
+    dirty = true;
+}
+
+const SeekPoint* SeekTable::find(int64_t frame) const {
+    auto it = std::upper_bound(points.begin(), points.end(), frame,
+                               [](int64_t f, const SeekPoint& p) { return f < p.frame; });
+    return it == points.begin() ? nullptr : &*(it - 1);
+}
+
+void SeekTable::mark_finished() {
+    if (!complete) dirty = true;
+    complete = true;
+}
+
+void SeekTable::save() {
+    if (!dirty || points.empty()) return;
+    dirty = false;
+
+    SeekTableHeader h = {};
+    memcpy(h.magic, SEEK_TABLE_MAGIC, sizeof(h.magic));
+    h.version = SEEK_TABLE_VERSION;
+    h.sample_rate = rate;
+    h.file_size = file_size;
+    h.mtime = mtime;
+    h.count = points.size();
+    h.complete = complete ? 1 : 0;
+
+    std::string tmp = table_path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    bool written = f && fwrite(&h, sizeof(h), 1, f) == 1 &&
+                   fwrite(points.data(), sizeof(SeekPoint), points.size(), f) == points.size();
+    if (f) written = (fclose(f) == 0) && written;
+    if (!written || rename(tmp.c_str(), table_path.c_str()) != 0) {
+        unlink(tmp.c_str());
+    }
+}
+
+void SeekTable::load() {
+    FILE* f = fopen(table_path.c_str(), "rb");
+    if (!f) return;
+
+    SeekTableHeader h = {};
+    if (fread(&h, sizeof(h), 1, f) == 1 &&
+        memcmp(h.magic, SEEK_TABLE_MAGIC, sizeof(h.magic)) == 0 &&
+        h.version == SEEK_TABLE_VERSION && h.sample_rate == rate &&
+        h.file_size == file_size && h.mtime == mtime && h.count <= file_size) {
+        points.resize(h.count);
+        if (fread(points.data(), sizeof(SeekPoint), points.size(), f) == points.size()) {
+            complete = (h.complete != 0);
+        } else {
+            points.clear();
+        }
+    }
+    fclose(f);
+}
+
+// --- Format Conversion ---
+
+std::vector<ChannelPosition> default_channel_layout(int channels) {
+    switch (channels) {
+        case 1: return {CH_MONO};
+        case 2: return {CH_FL, CH_FR};
+        case 3: return {CH_FL, CH_FR, CH_FC};
+        case 4: return {CH_FL, CH_FR, CH_BL, CH_BR};
+        case 5: return {CH_FL, CH_FR, CH_FC, CH_BL, CH_BR};
+        case 6: return {CH_FL, CH_FR, CH_FC, CH_LFE, CH_BL, CH_BR};
+        case 7: return {CH_FL, CH_FR, CH_FC, CH_LFE, CH_BC, CH_SL, CH_SR};
+        default: {
+            std::vector<ChannelPosition> layout = {CH_FL, CH_FR, CH_FC, CH_LFE, CH_BL, CH_BR, CH_SL, CH_SR};
+            layout.resize(std::max(channels, 0), CH_NONE); // extra channels are dropped
+            return layout;
+        }
+    }
+}
+
+uint32_t spa_channel_position(ChannelPosition position) {
+    switch (position) {
+        case CH_MONO: return SPA_AUDIO_CHANNEL_MONO;
+        case CH_FL: return SPA_AUDIO_CHANNEL_FL;
+        case CH_FR: return SPA_AUDIO_CHANNEL_FR;
+        case CH_FC: return SPA_AUDIO_CHANNEL_FC;
+        case CH_LFE: return SPA_AUDIO_CHANNEL_LFE;
+        case CH_BL: return SPA_AUDIO_CHANNEL_RL;
+        case CH_BR: return SPA_AUDIO_CHANNEL_RR;
+        case CH_SL: return SPA_AUDIO_CHANNEL_SL;
+        case CH_SR: return SPA_AUDIO_CHANNEL_SR;
+        case CH_BC: return SPA_AUDIO_CHANNEL_RC;
+        default: return SPA_AUDIO_CHANNEL_UNKNOWN;
+    }
+}
+
+void FormatConverter::configure(int in_rate, int in_ch, int out_rate, int out_ch) {
+    input_rate = in_rate;
+    input_channels = in_ch;
+    output_rate_hz = out_rate;
+    output_ch = out_ch;
+    build_matrix();
+    resampling = (in_rate != out_rate);
+    if (resampling) design_filter();
+    reset();
+}
+
+bool FormatConverter::matches(int in_rate, int in_ch) const {
+    return in_rate == input_rate && in_ch == input_channels;
+}
+
+sf_count_t FormatConverter::output_frames(sf_count_t frames) const {
+    return input_rate > 0 ? frames * output_rate_hz / input_rate : frames;
+}
+
+void FormatConverter::reset() {
+    history.assign(output_ch, std::vector<float>(resampling ? taps / 2 - 1 : 0, 0.0f));
+    phase = 0;
+}
+
+void FormatConverter::flush(std::vector<float>& out) {
+    if (!resampling) return;
+    std::vector<float> silence(static_cast<size_t>(taps / 2) * input_channels, 0.0f);
+    process(silence.data(), taps / 2, out);
+    reset();
+}
+
+void FormatConverter::process(const float* in, size_t frames, std::vector<float>& out) {
+    if (!resampling) {
+        size_t base = out.size();
+        out.resize(base + frames * output_ch);
+        remap(in, frames, out.data() + base);
+        return;
+    }
+
+    // Remap into per-channel planar history so every tap window is
+    // contiguous, then run the filter bank over it
+    size_t base = history[0].size();
+    for (auto& h : history) h.resize(base + frames);
+    for (size_t f = 0; f < frames; ++f) {
+        const float* src = in + f * input_channels;
+        for (int o = 0; o < output_ch; ++o) {
+            const float* row = matrix.data() + o * input_channels;
+            float v = 0.0f;
+            for (int i = 0; i < input_channels; ++i) v += row[i] * src[i];
+            history[o][base + f] = v;
+        }
+    }
+
+    size_t available = history[0].size();
+    size_t pos = 0;
+    out.reserve(out.size() + ((available * interp) / decim + 2) * output_ch);
+    while (pos + taps <= available) {
+        const float* filter = filters.data() + static_cast<size_t>(phase) * taps;
+        for (int o = 0; o < output_ch; ++o) {
+            out.push_back(dot_product(history[o].data() + pos, filter, taps));
+        }
+        phase += decim;
+        pos += phase / interp;
+        phase %= interp;
+    }
+    for (auto& h : history) h.erase(h.begin(), h.begin() + pos);
+}
+
+void FormatConverter::build_matrix() {
+    std::vector<ChannelPosition> in_layout = default_channel_layout(input_channels);
+    std::vector<ChannelPosition> out_layout = default_channel_layout(output_ch);
+    matrix.assign(static_cast<size_t>(output_ch) * input_channels, 0.0f);
+
+    auto find = [&](ChannelPosition p) {
+        auto it = std::find(out_layout.begin(), out_layout.end(), p);
+        return it == out_layout.end() ? -1 : static_cast<int>(it - out_layout.begin());
+    };
+    auto add = [&](ChannelPosition p, int in, float gain) {
+        int o = find(p);
+        if (o < 0) return false;
+        matrix[o * input_channels + in] += gain;
+        return true;
+    };
+
+    const float side = 0.70710678f;
+    for (int i = 0; i < input_channels; ++i) {
+        ChannelPosition p = in_layout[i];
+        if (p == CH_NONE || add(p, i, 1.0f)) continue;
+
+        if (output_ch == 1) {
+            if (p != CH_LFE) matrix[i] = 1.0f; // averaged by the normalisation below
+            continue;
+        }
+        switch (p) {
+            case CH_MONO:
+                if (!add(CH_FC, i, 1.0f)) {
+                    add(CH_FL, i, 1.0f);
+                    add(CH_FR, i, 1.0f);
+                }
+                break;
+            case CH_FC:
+                add(CH_FL, i, side);
+                add(CH_FR, i, side);
+                break;
+            case CH_BL:
+                if (!add(CH_SL, i, 1.0f)) add(CH_FL, i, side);
+                break;
+            case CH_BR:
+                if (!add(CH_SR, i, 1.0f)) add(CH_FR, i, side);
+                break;
+            case CH_SL:
+                if (!add(CH_BL, i, 1.0f)) add(CH_FL, i, side);
+                break;
+            case CH_SR:
+                if (!add(CH_BR, i, 1.0f)) add(CH_FR, i, side);
+                break;
+            case CH_BC:
+                if (!(add(CH_BL, i, side) && add(CH_BR, i, side))) {
+                    add(CH_FL, i, side);
+                    add(CH_FR, i, side);
+                }
+                break;
+            default: // LFE without a subwoofer is dropped
+                break;
+        }
+    }
+
+    // Keep every output within full scale when several inputs fold in
+    identity = (input_channels == output_ch);
+    for (int o = 0; o < output_ch; ++o) {
+        float* row = matrix.data() + o * input_channels;
+        float sum = 0.0f;
+        for (int i = 0; i < input_channels; ++i) sum += row[i];
+        if (sum > 1.0f) {
+            for (int i = 0; i < input_channels; ++i) row[i] /= sum;
+        }
+        for (int i = 0; i < input_channels; ++i) {
+            identity = identity && row[i] == (i == o ? 1.0f : 0.0f);
+        }
+    }
+}
+
+void FormatConverter::remap(const float* in, size_t frames, float* out) const {
+    if (identity) {
+        memcpy(out, in, frames * output_ch * sizeof(float));
+        return;
+    }
+    for (size_t f = 0; f < frames; ++f) {
+        const float* src = in + f * input_channels;
+        float* dst = out + f * output_ch;
+        for (int o = 0; o < output_ch; ++o) {
+            const float* row = matrix.data() + o * input_channels;
+            float v = 0.0f;
+            for (int i = 0; i < input_channels; ++i) v += row[i] * src[i];
+            dst[o] = v;
+        }
+    }
+}
+
+double FormatConverter::bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+void FormatConverter::design_filter() {
+    int g = std::gcd(input_rate, output_rate_hz);
+    interp = output_rate_hz / g;
+    decim = input_rate / g;
+    if (interp > RESAMPLER_MAX_PHASES) {
+        // Odd rate pairs: approximate the ratio (pitch error < 0.1%)
+        decim = std::max(1, static_cast<int>(std::lround(static_cast<double>(decim) * RESAMPLER_MAX_PHASES / interp)));
+        interp = RESAMPLER_MAX_PHASES;
+    }
+
+    double ratio = static_cast<double>(interp) / decim;
+    taps = RESAMPLER_TAPS * std::max(1, static_cast<int>(std::ceil(1.0 / ratio)));
+    taps = std::min(RESAMPLER_MAX_TAPS, (taps + 7) / 8 * 8);
+
+    const double beta = 8.6;
+    double cutoff = 0.95 * std::min(1.0, ratio) / (2.0 * interp); // cycles per upsampled sample
+    int length = taps * interp;
+    double center = static_cast<double>(taps / 2) * interp; // lands on an input frame
+    double norm = bessel_i0(beta);
+
+    filters.assign(length, 0.0f);
+    for (int p = 0; p < interp; ++p) {
+        for (int i = 0; i < taps; ++i) {
+            int k = p + (taps - 1 - i) * interp;
+            double t = k - center;
+            double sinc = (t == 0.0) ? 1.0 : std::sin(2.0 * M_PI * cutoff * t) / (2.0 * M_PI * cutoff * t);
+            double w = t / (length / 2.0);
+            double window = (std::fabs(w) <= 1.0) ? bessel_i0(beta * std::sqrt(1.0 - w * w)) / norm : 0.0;
+            filters[p * taps + i] = static_cast<float>(2.0 * cutoff * interp * sinc * window);
+        }
+    }
+}
+
+// --- Telemetry ---
+
+void AudioTelemetry::record(uint64_t duration_ns, uint32_t requested, uint32_t delivered, size_t fill, bool playing) {
+    bump(callbacks);
+    add<uint64_t>(frames_requested, requested);
+    add<uint64_t>(frames_delivered, delivered);
+    if (playing && delivered < requested) bump(short_callbacks);
+    quantum.store(requested, std::memory_order_relaxed);
+    ring_fill.store(fill, std::memory_order_relaxed);
+    if (playing && fill < ring_min_fill.load(std::memory_order_relaxed)) {
+        ring_min_fill.store(fill, std::memory_order_relaxed);
+    }
+
+    uint64_t us = duration_ns / 1000;
+    int bucket = us == 0 ? 0 : std::min(HISTOGRAM_BUCKETS - 1, 64 - __builtin_clzll(us));
+    bump(histogram[bucket]);
+    if (duration_ns > max_duration_ns.load(std::memory_order_relaxed)) {
+        max_duration_ns.store(duration_ns, std::memory_order_relaxed);
+    }
+}
+
+uint64_t AudioTelemetry::Snapshot::percentile_us(double q) const {
+    uint64_t total = 0;
+    for (uint64_t n : histogram) total += n;
+    if (total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * (total - 1));
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram[i];
+        if (seen > rank) return 1ULL << i;
+    }
+    return 1ULL << (HISTOGRAM_BUCKETS - 1);
+}
+
+AudioTelemetry::Snapshot AudioTelemetry::snapshot() const {
+    Snapshot s;
+    s.callbacks = callbacks.load(std::memory_order_relaxed);
+    s.frames_requested = frames_requested.load(std::memory_order_relaxed);
+    s.frames_delivered = frames_delivered.load(std::memory_order_relaxed);
+    s.short_callbacks = short_callbacks.load(std::memory_order_relaxed);
+    s.out_of_buffers = out_of_buffers.load(std::memory_order_relaxed);
+    s.quantum = quantum.load(std::memory_order_relaxed);
+    s.ring_fill = ring_fill.load(std::memory_order_relaxed);
+    size_t low = ring_min_fill.load(std::memory_order_relaxed);
+    s.ring_min_fill = low == SIZE_MAX ? s.ring_fill : low;
+    s.max_duration_ns = max_duration_ns.load(std::memory_order_relaxed);
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        s.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+void OutputTap::push(const float* frames, size_t count, int channels) {
+    if (count > WINDOW) {
+        frames += (count - WINDOW) * channels;
+        count = WINDOW;
+    }
+    uint64_t pos = written.load(std::memory_order_relaxed);
+    size_t at = static_cast<size_t>(pos) & (CAPACITY - 1);
+    if (channels == CHANNELS) {
+        size_t first = std::min(count, CAPACITY - at);
+        memcpy(&samples[at * CHANNELS], frames, first * CHANNELS * sizeof(float));
+        memcpy(&samples[0], frames + first * CHANNELS, (count - first) * CHANNELS * sizeof(float));
+    } else {
+        int right = channels > 1 ? 1 : 0;
+        for (size_t i = 0; i < count; ++i) {
+            size_t slot = ((at + i) & (CAPACITY - 1)) * CHANNELS;
+            samples[slot] = frames[i * channels];
+            samples[slot + 1] = frames[i * channels + right];
+        }
+    }
+    written.store(pos + count, std::memory_order_release);
+}
+
+uint64_t OutputTap::read_latest(float* out, size_t count) const {
+    count = std::min(count, WINDOW);
+    uint64_t end = written.load(std::memory_order_acquire);
+    if (end == 0) return 0;
+    size_t live = static_cast<size_t>(std::min<uint64_t>(count, end));
+    std::fill(out, out + (count - live) * CHANNELS, 0.0f);
+    out += (count - live) * CHANNELS;
+
+    uint64_t begin = end - live;
+    size_t at = static_cast<size_t>(begin) & (CAPACITY - 1);
+    size_t first = std::min(live, CAPACITY - at);
+    memcpy(out, &samples[at * CHANNELS], first * CHANNELS * sizeof(float));
+    memcpy(out + first * CHANNELS, &samples[0], (live - first) * CHANNELS * sizeof(float));
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return written.load(std::memory_order_relaxed) - begin > WINDOW ? 0 : end;
+}
+
+// --- Audio Sources ---
+
+bool mmap_enabled = true;
+
+// Whole-file read-only mapping behind SF_VIRTUAL_IO. The kernel is told
+// the access is sequential, and every read that nears the end of the last
+// hinted window asks for the next MAPPED_READAHEAD_BYTES, so page-ins run
+// ahead of the decoder thread instead of stalling it. Like any mapping it
+// faults if the file is truncated underneath it while playing.
+class MappedFile {
+public:
+    static std::unique_ptr<MappedFile> open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return nullptr;
+
+        std::unique_ptr<MappedFile> file;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                file.reset(new MappedFile(static_cast<const char*>(addr), static_cast<size_t>(st.st_size)));
+            }
+        }
+        close(fd); // the mapping keeps the file referenced
+        return file;
+    }
+
+    ~MappedFile() { munmap(const_cast<char*>(data), size); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    static SF_VIRTUAL_IO* io() {
+        static SF_VIRTUAL_IO vio = {&MappedFile::vio_length, &MappedFile::vio_seek, &MappedFile::vio_read,
+                                    &MappedFile::vio_write, &MappedFile::vio_tell};
+        return &vio;
+    }
+
+private:
+    static const size_t MAPPED_READAHEAD_BYTES = 4 * 1024 * 1024;
+
+    MappedFile(const char* data, size_t size) : data(data), size(size) {}
+
+    // Called from vio_read, i.e. on the decoder thread
+    void advise() {
+        if (pos >= hinted_from && pos + MAPPED_READAHEAD_BYTES / 2 <= hinted_to) return;
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t from = pos / page * page;
+        size_t to = std::min(size, pos + MAPPED_READAHEAD_BYTES);
+        if (to > from) madvise(const_cast<char*>(data) + from, to - from, MADV_WILLNEED);
+        hinted_from = from;
+        hinted_to = to;
+    }
+
+    static sf_count_t vio_length(void* user) {
+        return static_cast<sf_count_t>(static_cast<MappedFile*>(user)->size);
+    }
+
+    static sf_count_t vio_seek(sf_count_t offset, int whence, void* user) {
+        MappedFile* self = static_cast<MappedFile*>(user);
+        sf_count_t base = whence == SEEK_CUR ? static_cast<sf_count_t>(self->pos)
+                        : whence == SEEK_END ? static_cast<sf_count_t>(self->size) : 0;
+        sf_count_t target = base + offset;
+        if (target < 0) return -1;
+        self->pos = static_cast<size_t>(target);
+        return target;
+    }
+
+    static sf_count_t vio_read(void* dst, sf_count_t count, void* user) {
+        MappedFile* self = static_cast<MappedFile*>(user);
+        if (self->pos >= self->size || count <= 0) return 0;
+        self->advise();
+        size_t n = std::min(static_cast<size_t>(count), self->size - self->pos);
+        memcpy(dst, self->data + self->pos, n);
+        self->pos += n;
+        return static_cast<sf_count_t>(n);
+    }
+
+    static sf_count_t vio_write(const void*, sf_count_t, void*) { return 0; }
+
+    static sf_count_t vio_tell(void* user) {
+        return static_cast<sf_count_t>(static_cast<MappedFile*>(user)->pos);
+    }
+
+    const char* data;
+    size_t size;
+    size_t pos = 0;
+    size_t hinted_from = 0;
+    size_t hinted_to = 0;
+};
+
+// Anything libsndfile can open (the offline library)
+class SndfileSource : public AudioSource {
+public:
+    static std::unique_ptr<AudioSource> open(const std::string& path) {
+        SF_INFO info = {};
+        std::unique_ptr<MappedFile> mapped = mmap_enabled ? MappedFile::open(path) : nullptr;
+        SNDFILE* f = mapped ? sf_open_virtual(MappedFile::io(), SFM_READ, &info, mapped.get())
+                            : sf_open(path.c_str(), SFM_READ, &info);
+        if (!f) return nullptr;
+        return std::unique_ptr<AudioSource>(new SndfileSource(f, info, std::move(mapped)));
+    }
+
+    ~SndfileSource() override { sf_close(sf); }
+
+    sf_count_t read(float* dst, sf_count_t frames) override {
+        return sf_readf_float(sf, dst, frames);
+    }
+
+    // Exact and cheap for PCM and FLAC (seek tables); Ogg bisects
+    bool seek(sf_count_t frame) override {
+        return seekable && sf_seek(sf, frame, SEEK_SET) == frame;
+    }
+
+private:
+    SndfileSource(SNDFILE* f, const SF_INFO& info, std::unique_ptr<MappedFile> mapped)
+        : sf(f), mapped(std::move(mapped)) {
+        sample_rate = info.samplerate;
+        channel_count = info.channels;
+        frame_count = info.frames;
+        seekable = info.seekable != 0;
+    }
+
+    SNDFILE* sf;
+    std::unique_ptr<MappedFile> mapped; // outlives sf, which reads through it
+    bool seekable = false;
+};
+
+std::unique_ptr<AudioSource> LibavSource::open_file(const std::string& path) {
+    std::unique_ptr<LibavSource> source(new LibavSource());
+    if (!source->open(path.c_str())) return nullptr;
+    return source;
+}
+
+std::unique_ptr<AudioSource> LibavSource::open_stream(std::shared_ptr<StreamDownload> download) {
+    std::unique_ptr<LibavSource> source(new LibavSource());
+    source->download = std::move(download);
+    if (!source->open("")) return nullptr;
+    return source;
+}
+
+LibavSource::~LibavSource() {
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    swr_free(&swr);
+    avcodec_free_context(&codec);
+    avformat_close_input(&format);
+    if (io) {
+        av_freep(&io->buffer);
+        avio_context_free(&io);
+    }
+}
+
+sf_count_t LibavSource::read(float* dst, sf_count_t frames) {
+    sf_count_t written = 0;
+    while (written < frames) {
+        if (pending_pos == pending_frames) {
+            if (!decode_next()) break;
+            continue;
+        }
+        size_t n = std::min<size_t>(frames - written, pending_frames - pending_pos);
+        memcpy(dst + written * channel_count, pending.data() + pending_pos * channel_count,
+               n * channel_count * sizeof(float));
+        pending_pos += n;
+        written += n;
+    }
+    return written;
+}
+
+bool LibavSource::seek(sf_count_t target) {
+    target = std::max<sf_count_t>(0, target);
+    if (seek_table ? !seek_with_table(target) : !seek_to_timestamp(target)) return false;
+
+    avcodec_flush_buffers(codec);
+    pending_frames = 0;
+    pending_pos = 0;
+    finished = false;
+    sequential = false;
+    seek_target = target;
+    return true;
+}
+
+bool LibavSource::open(const char* url) {
+    format = avformat_alloc_context();
+    if (!format) return false;
+    format->interrupt_callback.callback = &LibavSource::check_interrupt;
+    format->interrupt_callback.opaque = this;
+
+    if (download) {
+        unsigned char* buffer = static_cast<unsigned char*>(av_malloc(IO_BUFFER_BYTES));
+        io = avio_alloc_context(buffer, IO_BUFFER_BYTES, 0, this,
+                                &LibavSource::read_packet, nullptr, &LibavSource::seek_packet);
+        if (!io) {
+            av_free(buffer);
+            return false;
+        }
+        format->pb = io;
+        format->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+
+    // Frees the context itself on failure
+    if (avformat_open_input(&format, url, nullptr, nullptr) < 0) return false;
+    if (avformat_find_stream_info(format, nullptr) < 0) return false;
+
+    const AVCodec* decoder = nullptr;
+    stream_index = av_find_best_stream(format, AVMEDIA_TYPE_AUDIO, -1, -1, &decoder, 0);
+    if (stream_index < 0 || !decoder) return false;
+    for (unsigned i = 0; i < format->nb_streams; ++i) {
+        if (static_cast<int>(i) != stream_index) format->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    AVStream* stream = format->streams[stream_index];
+    codec = avcodec_alloc_context3(decoder);
+    if (!codec || avcodec_parameters_to_context(codec, stream->codecpar) < 0 ||
+        avcodec_open2(codec, decoder, nullptr) < 0) {
+        return false;
+    }
+
+    sample_rate = codec->sample_rate;
+    channel_count = codec->ch_layout.nb_channels;
+    if (sample_rate <= 0 || channel_count <= 0) return false;
+
+    // Only the sample format changes; rate and layout pass through
+    if (swr_alloc_set_opts2(&swr, &codec->ch_layout, AV_SAMPLE_FMT_FLT, sample_rate,
+                            &codec->ch_layout, codec->sample_fmt, sample_rate, 0, nullptr) < 0 ||
+        swr_init(swr) < 0) {
+        return false;
+    }
+
+    if (stream->duration != AV_NOPTS_VALUE) {
+        frame_count = av_rescale_q(stream->duration, stream->time_base, AVRational{1, sample_rate});
+    } else if (format->duration != AV_NOPTS_VALUE) {
+        frame_count = av_rescale(format->duration, sample_rate, AV_TIME_BASE);
+    }
+    start_pts = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+
+    // Raw elementary streams have nothing to seek by but bytes
+    const char* demuxer = format->iformat->name;
+    if (!download && (strcmp(demuxer, "mp3") == 0 || strcmp(demuxer, "aac") == 0)) {
+        seek_table = std::make_unique<SeekTable>(url, sample_rate);
+    }
+
+    packet = av_packet_alloc();
+    frame = av_frame_alloc();
+    return packet && frame;
+}
+
+bool LibavSource::decode_next() {
+    while (!finished) {
+        int ret = avcodec_receive_frame(codec, frame);
+        if (ret == 0) {
+            int64_t pts = frame->best_effort_timestamp;
+            int capacity = swr_get_out_samples(swr, frame->nb_samples);
+            pending.resize(static_cast<size_t>(std::max(capacity, 0)) * channel_count);
+            uint8_t* out[1] = {reinterpret_cast<uint8_t*>(pending.data())};
+            int got = swr_convert(swr, out, capacity,
+                                  const_cast<const uint8_t**>(frame->extended_data), frame->nb_samples);
+            av_frame_unref(frame);
+            if (got < 0) break;
+            pending_frames = got;
+            pending_pos = 0;
+
+            // After a seek, drop whatever precedes the target frame
+            if (seek_target >= 0) {
+                if (position < 0) position = (pts != AV_NOPTS_VALUE) ? to_frames(pts) : seek_target;
+                sf_count_t skip = seek_target - position;
+                position += got;
+                if (skip >= got) continue;
+                pending_pos = static_cast<size_t>(std::max<sf_count_t>(0, skip));
+                seek_target = -1;
+            }
+            if (got > 0) return true;
+            continue;
+        }
+        if (ret != AVERROR(EAGAIN)) break; // AVERROR_EOF after draining
+
+        // The decoder wants input: feed it the next packet, or flush at
+        // the end of the container (or when interrupted)
+        ret = av_read_frame(format, packet);
+        if (ret < 0) {
+            if (ret == AVERROR_EOF && seek_table && sequential) seek_table->mark_finished();
+            avcodec_send_packet(codec, nullptr);
+            continue;
+        }
+        if (packet->stream_index == stream_index) {
+            // Straight playback from the top extends the table for free
+            if (seek_table && sequential && packet->pts != AV_NOPTS_VALUE) {
+                seek_table->add(to_frames(packet->pts), packet->pos);
+            }
+            avcodec_send_packet(codec, packet); // a corrupt packet is just skipped
+        }
+        av_packet_unref(packet);
+    }
+    finished = true;
+    return false;
+}
+
+sf_count_t LibavSource::to_frames(int64_t pts) const {
+    return av_rescale_q(pts - start_pts, format->streams[stream_index]->time_base,
+                        AVRational{1, sample_rate});
+}
+
+bool LibavSource::seek_to_timestamp(sf_count_t target) {
+    AVStream* stream = format->streams[stream_index];
+    int64_t ts = start_pts + av_rescale_q(target, AVRational{1, sample_rate}, stream->time_base);
+    if (av_seek_frame(format, stream_index, ts, AVSEEK_FLAG_BACKWARD) < 0) return false;
+    position = -1; // taken from the first decoded frame's timestamp
+    return true;
+}
+
+bool LibavSource::seek_with_table(sf_count_t target) {
+    sf_count_t aim = std::max<sf_count_t>(0, target - static_cast<sf_count_t>(sample_rate) * SEEK_PREROLL_MS / 1000);
+    const SeekPoint* last = seek_table->last();
+    if (!seek_table->finished() && (!last || last->frame < aim)) {
+        scan_to(aim);
+    }
+
+    // The top of the file is best reached the way it was opened, so the
+    // encoder delay is skipped again
+    const SeekPoint* point = seek_table->find(aim);
+    if (!point || point->frame <= 0) return seek_to_timestamp(0);
+
+    if (av_seek_frame(format, stream_index, point->offset, AVSEEK_FLAG_BYTE) < 0) return false;
+    position = point->frame;
+    return true;
+}
+
+void LibavSource::scan_to(sf_count_t aim) {
+    AVStream* stream = format->streams[stream_index];
+    const SeekPoint* last = seek_table->last();
+    sf_count_t cursor = last ? last->frame : 0;
+    if (last ? av_seek_frame(format, stream_index, last->offset, AVSEEK_FLAG_BYTE) < 0
+             : av_seek_frame(format, stream_index, start_pts, AVSEEK_FLAG_BACKWARD) < 0) {
+        return;
+    }
+
+    bool timed_by_pts = (last == nullptr);
+    while (cursor < aim && !interrupted) {
+        int ret = av_read_frame(format, packet);
+        if (ret < 0) {
+            if (ret == AVERROR_EOF) seek_table->mark_finished();
+            break;
+        }
+        if (packet->stream_index == stream_index) {
+            if (timed_by_pts && packet->pts != AV_NOPTS_VALUE) cursor = to_frames(packet->pts);
+            seek_table->add(cursor, packet->pos);
+            if (packet->duration <= 0) {
+                av_packet_unref(packet);
+                break; // can't time the rest; seek to the nearest point known
+            }
+            cursor += av_rescale_q(packet->duration, stream->time_base, AVRational{1, sample_rate});
+        }
+        av_packet_unref(packet);
+    }
+    seek_table->save();
+}
+
+int LibavSource::read_packet(void* opaque, uint8_t* buf, int size) {
+    LibavSource* self = static_cast<LibavSource*>(opaque);
+    ssize_t n = self->download->read_at(self->io_pos, buf, size, self->interrupted);
+    if (n < 0) return self->interrupted ? AVERROR_EXIT : AVERROR(EIO);
+    if (n == 0) return AVERROR_EOF;
+    self->io_pos += n;
+    return static_cast<int>(n);
+}
+
+int64_t LibavSource::seek_packet(void* opaque, int64_t offset, int whence) {
+    LibavSource* self = static_cast<LibavSource*>(opaque);
+    int64_t size = self->download->size();
+    if (whence & AVSEEK_SIZE) return size >= 0 ? size : AVERROR(ENOSYS);
+
+    int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+        case SEEK_SET: pos = offset; break;
+        case SEEK_CUR: pos = self->io_pos + offset; break;
+        case SEEK_END:
+            if (size < 0) return AVERROR(ENOSYS);
+            pos = size + offset;
+            break;
+        default: return AVERROR(EINVAL);
+    }
+    if (pos < 0) return AVERROR(EINVAL);
+    self->io_pos = pos;
+    return pos;
+}
+
+int LibavSource::check_interrupt(void* opaque) {
+    return static_cast<LibavSource*>(opaque)->interrupted.load() ? 1 : 0;
+}
+
+std::unique_ptr<AudioSource> open_audio_source(const std::string& path) {
+    std::string ext = fs::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (ext == ".mp3") {
+        if (auto source = LibavSource::open_file(path)) return source;
+    }
+    if (auto source = SndfileSource::open(path)) return source;
+    return LibavSource::open_file(path);
+}
+
+const struct pw_stream_events PlaybackEngine::stream_events = {
+    PW_VERSION_STREAM_EVENTS,
+    .param_changed = PlaybackEngine::on_param_changed,
+    .process = PlaybackEngine::on_process,
+};
+
+PlaybackEngine g_engine;
+
+bool PlaybackEngine::start() {
+    notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    pw_init(nullptr, nullptr);
+
+    loop = pw_thread_loop_new("uwu-playback", nullptr);
+    if (!loop) {
+        pw_deinit();
+        return false;
+    }
+
+    pw_thread_loop_lock(loop);
+    stream = pw_stream_new_simple(
+        pw_thread_loop_get_loop(loop),
+        "Music Player",
+        pw_properties_new(
+            PW_KEY_MEDIA_TYPE, "Audio",
+            PW_KEY_MEDIA_CATEGORY, "Playback",
+            PW_KEY_MEDIA_ROLE, "Music",
+            nullptr),
+        &stream_events,
+        this);
+    pw_thread_loop_unlock(loop);
+
+    if (!stream) {
+        pw_thread_loop_destroy(loop);
+        loop = nullptr;
+        pw_deinit();
+        return false;
+    }
+
+    if (pw_thread_loop_start(loop) < 0) {
+        pw_stream_destroy(stream);
+        pw_thread_loop_destroy(loop);
+        stream = nullptr;
+        loop = nullptr;
+        pw_deinit();
+        return false;
+    }
+
+    device_rate = output_rate;
+    device_channels = output_channels;
+    if (!connect_stream()) {
+        pw_thread_loop_stop(loop);
+        pw_stream_destroy(stream);
+        pw_thread_loop_destroy(loop);
+        stream = nullptr;
+        loop = nullptr;
+        pw_deinit();
+        return false;
+    }
+    return true;
+}
+
+void PlaybackEngine::shutdown() {
+    if (!loop) return;
+
+    stop();
+
+    pw_thread_loop_stop(loop);
+    pw_stream_destroy(stream);
+    pw_thread_loop_destroy(loop);
+    stream = nullptr;
+    loop = nullptr;
+    connected = false;
+
+    pw_deinit();
+
+    if (notify_fd >= 0) {
+        close(notify_fd);
+        notify_fd = -1;
+    }
+}
+
+// Wake the UI; a single non-blocking eventfd write, safe from the RT thread
+void PlaybackEngine::notify() {
+    uint64_t one = 1;
+    if (notify_fd >= 0 && write(notify_fd, &one, sizeof(one)) < 0) {}
+}
+
+// PipeWire stream process callback
+void PlaybackEngine::on_process(void* userdata) {
+    static_cast<PlaybackEngine*>(userdata)->process();
+}
+
+void PlaybackEngine::on_param_changed(void* userdata, uint32_t id, const struct spa_pod* param) {
+    PlaybackEngine* engine = static_cast<PlaybackEngine*>(userdata);
+    if (id != SPA_PARAM_Format || param == nullptr) return;
+
+    struct spa_audio_info_raw info = {};
+    if (spa_format_audio_raw_parse(param, &info) >= 0) {
+        engine->negotiated_channels = info.channels;
+    }
+}
+
+void PlaybackEngine::process() {
+    struct pw_buffer *b;
+    struct spa_buffer *buf;
+    float *dst;
+    uint32_t n_frames;
+
+    bool measure = rt_telemetry.enabled();
+    auto began = measure ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    
+    if ((b = pw_stream_dequeue_buffer(stream)) == NULL) {
+        rt_telemetry.missed_buffer();
+        return;
+    }
+    
+    buf = b->buffer;
+    if ((dst = (float*)buf->datas[0].data) == NULL)
+        return;
+
+    in_process++;
+
+    // Fill what the graph asked for this cycle (older servers leave
+    // requested at 0), never more than the buffer holds
+    int stride_channels = std::max(1, negotiated_channels.load());
+    n_frames = buf->datas[0].maxsize / sizeof(float) / stride_channels;
+    if (b->requested > 0) n_frames = std::min<uint32_t>(n_frames, static_cast<uint32_t>(b->requested));
+    uint32_t delivered = 0;
+
+    // A seek landed: skip the stale audio, even while paused, and refill
+    if (source_active && seek_pending.load(std::memory_order_acquire)) {
+        ring.discard_to(seek_pos.load());
+        current_frame = seek_frame.load();
+        buffering_state = true;
+        seek_pending.store(false, std::memory_order_release);
+        notify();
+    }
+
+
+    // Expected to deliver real audio this cycle
+    bool playing = source_active && !is_paused && !buffering_state && ring.channels == stride_channels;
+    
+    if (is_paused || !source_active || ring.channels != stride_channels) {
+        memset(dst, 0, n_frames * sizeof(float) * stride_channels);
+    } else if (buffering_state) {
+        // Hold output until the watermark is reached or the source ended
+        memset(dst, 0, n_frames * sizeof(float) * stride_channels);
+        if (ring.readable() >= watermark_frames.load() || decoder_eof) {
+            buffering_state = false;
+            notify();
+        }
+    } else {
+        // Copy decoded audio out of the ring; never touch the file here.
+        // A spliced track boundary may fall anywhere inside this quantum.
+        size_t start = ring.consumed();
+        size_t frames_read = ring.read(dst, n_frames);
+        delivered = static_cast<uint32_t>(frames_read);
+        if (boundary_pending && start + frames_read >= boundary_pos.load()) {
+            current_frame = static_cast<sf_count_t>(start + frames_read - boundary_pos.load());
+            total_frames = boundary_total.load();
+            boundary_pending = false;
+            track_change_count++;
+            notify();
+        } else {
+            current_frame += frames_read;
+        }
+        
+        if (frames_read < n_frames) {
+            // Fill remaining with silence
+            memset(dst + frames_read * stride_channels, 0, 
+                   (n_frames - frames_read) * sizeof(float) * stride_channels);
+            if (decoder_eof) {
+                if (frames_read == 0 && is_playing.exchange(false)) {
+                    notify();
+                }
+            } else {
+                // Ran dry mid-track: rebuffer, to a higher mark than last time
+                underrun_count++;
+                rebuffer_count++;
+                size_t raised = std::max(watermark_frames.load() * 2, ring.capacity / 16);
+                watermark_frames = std::min(raised, max_watermark_frames);
+                buffering_state = true;
+                notify();
+            }
+        }
+    }
+
+    if (tap.enabled()) tap.push(dst, n_frames, stride_channels);
+
+    size_t fill = source_active ? ring.readable() : 0;
+    in_process--;
+    
+    buf->datas[0].chunk->offset = 0;
+    buf->datas[0].chunk->stride = sizeof(float) * stride_channels;
+    buf->datas[0].chunk->size = n_frames * sizeof(float) * stride_channels;
+    
+    pw_stream_queue_buffer(stream, b);
+
+    if (measure) {
+        auto took = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - began);
+        rt_telemetry.record(static_cast<uint64_t>(took.count()), n_frames, delivered, fill, playing);
+    }
+}
+
+// Decoder thread: keeps the ring topped up so on_process never touches the file
+void PlaybackEngine::decoder_loop() {
+    auto idle = std::chrono::milliseconds(std::max(1, std::min(10, ring_buffer_ms / 4)));
+
+    while (!decoder_stop) {
+        sf_count_t seek_to = seek_request.exchange(-1);
+        if (seek_to >= 0) {
+            apply_seek(seek_to);
+            continue;
+        }
+        // Stay around after the end so a seek back still works until the
+        // ring runs dry
+        if (decoder_eof) {
+            std::this_thread::sleep_for(idle);
+            continue;
+        }
+
+        // The successor changed after it was pre-opened
+        if (next_changed.exchange(false) && next_source) {
+            std::unique_ptr<AudioSource> stale;
+            std::lock_guard<std::mutex> lock(next_mutex);
+            if (next_path == next_source_path) {
+                next_path.clear();
+            } else {
+                stale = std::move(next_source);
+                next_source_path.clear();
+            }
+        }
+
+        // Sources of unknown length can't be pre-opened against; they fall
+        // back to the UI starting the next track at EOF
+        sf_count_t preopen_frames = static_cast<sf_count_t>(source->rate()) * GAPLESS_PREOPEN_MS / 1000;
+        if (gapless_enabled && !next_source && decode_total > 0 &&
+            decode_total - decode_pos <= preopen_frames) {
+            preopen_next();
+        }
+
+        decoded.resize(static_cast<size_t>(DECODE_CHUNK_FRAMES) * source->channels());
+        sf_count_t got = source->read(decoded.data(), DECODE_CHUNK_FRAMES);
+        if (got > 0) {
+            decode_pos += got;
+            if (!convert_and_write(decoded.data(), got, true)) continue;
+        }
+        if (got < DECODE_CHUNK_FRAMES && !splice_next()) {
+            if (flush_converter()) decoder_eof = true;
+        }
+    }
+}
+
+// Reposition the source on a request from seek(); `frame` is in progress
+// (device) units
+void PlaybackEngine::apply_seek(sf_count_t frame) {
+    // Once the next track is spliced in, the one on screen is fully decoded
+    if (boundary_pending) return;
+
+    sf_count_t target = static_cast<sf_count_t>(
+        static_cast<double>(frame) * source->rate() / std::max(1, device_rate));
+    if (decode_total > 0) target = std::min(target, decode_total);
+    if (!source->seek(target)) return;
+
+    // Hand over one seek at a time so on_process never mixes two
+    auto idle = std::chrono::milliseconds(1);
+    while (seek_pending && !decoder_stop) {
+        std::this_thread::sleep_for(idle);
+    }
+
+    converter.reset();
+    decode_pos = target;
+    decoder_eof = false;
+    seek_frame = converter.output_frames(target);
+    seek_pos = ring.produced();
+    seek_pending.store(true, std::memory_order_release);
+}
+
+// Convert source frames to the device format and queue them for on_process
+bool PlaybackEngine::convert_and_write(const float* frames, sf_count_t count, bool yield_to_seek) {
+    auto begin = std::chrono::steady_clock::now();
+    converted.clear();
+    converter.process(frames, static_cast<size_t>(count), converted);
+    if (gain_lookup) apply_gain_limited(converted.data(), converted.size(), decode_gain);
+    convert_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+
+    size_t out_frames = converted.size() / ring.channels;
+    converted_frames += out_frames;
+    return write_ring(converted.data(), out_frames, yield_to_seek);
+}
+
+// Emit the resampler's tail before the source format changes or ends
+bool PlaybackEngine::flush_converter() {
+    converted.clear();
+    converter.flush(converted);
+    if (gain_lookup) apply_gain_limited(converted.data(), converted.size(), decode_gain);
+    return write_ring(converted.data(), converted.size() / ring.channels, false);
+}
+
+// Copy frames into the ring, waiting for on_process to free space.
+// Returns false if the decoder was told to stop meanwhile, or with
+// yield_to_seek when a seek arrived (the rest is stale anyway).
+bool PlaybackEngine::write_ring(const float* frames, size_t count, bool yield_to_seek) {
+    // Poll at a fraction of the ring depth so a full ring is never drained
+    // by more than a quarter before we are back
+    auto idle = std::chrono::milliseconds(std::max(1, std::min(10, ring_buffer_ms / 4)));
+
+    size_t written = 0;
+    while (written < count) {
+        if (decoder_stop || (yield_to_seek && seek_request.load() >= 0)) return false;
+        float* region;
+        size_t space = ring.write_region(&region);
+        if (space == 0) {
+            std::this_thread::sleep_for(idle);
+            continue;
+        }
+        size_t n = std::min(space, count - written);
+        memcpy(region, frames + written * ring.channels, n * ring.channels * sizeof(float));
+        ring.commit_write(n);
+        written += n;
+    }
+    return true;
+}
+
+// Open the queued next track and decode its first few hundred ms
+void PlaybackEngine::preopen_next() {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(next_mutex);
+        path.swap(next_path);
+    }
+    if (path.empty()) return;
+
+    std::unique_ptr<AudioSource> next = open_audio_source(path);
+    if (!next) return;
+
+    next_total = next->frames();
+    next_gain = gain_lookup ? gain_lookup(path) : 1.0f;
+
+    sf_count_t want = static_cast<sf_count_t>(next->rate()) * GAPLESS_PREROLL_MS / 1000;
+    preroll.resize(static_cast<size_t>(want) * next->channels());
+    preroll_frames = std::max<sf_count_t>(0, next->read(preroll.data(), want));
+
+    next_source = std::move(next);
+    next_source_path = std::move(path);
+}
+
+// Continue the ring with the pre-opened track. Any source format splices:
+// the converter carries its filter state across tracks of the same format
+// and is drained and reconfigured when the format changes.
+bool PlaybackEngine::splice_next() {
+    if (!next_source) return false;
+
+    // One boundary in flight at a time: wait for on_process to cross the last
+    auto idle = std::chrono::milliseconds(1);
+    while (boundary_pending && !decoder_stop) {
+        std::this_thread::sleep_for(idle);
+    }
+    if (decoder_stop) return true;
+
+    if (!converter.matches(next_source->rate(), next_source->channels())) {
+        if (!flush_converter()) return true;
+        converter.configure(next_source->rate(), next_source->channels(), device_rate, device_channels);
+    }
+
+    // Publish the boundary before any frame of the new track is committed
+    boundary_total = converter.output_frames(next_total);
+    boundary_pos = ring.produced();
+    boundary_pending = true;
+
+    // Anything the flush above emitted still belonged to the old track
+    source = std::move(next_source);
+    decode_gain = next_gain;
+    {
+        std::lock_guard<std::mutex> lock(next_mutex);
+        spliced = std::move(next_source_path);
+        next_source_path.clear();
+    }
+    decode_total = next_total;
+    decode_pos = preroll_frames;
+    if (preroll_frames > 0) convert_and_write(preroll.data(), preroll_frames);
+    return true;
+}
+
+// Take the current source away from the RT thread and close it
+void PlaybackEngine::detach_source() {
+    source_active = false;
+    while (in_process.load() != 0) {
+        std::this_thread::yield();
+    }
+
+    // A streaming source may be blocked waiting for bytes
+    decoder_stop = true;
+    if (source) source->interrupt();
+    if (decoder_thread.joinable()) {
+        decoder_thread.join();
+    }
+    decoder_stop = false;
+    decoder_eof = false;
+
+    source.reset();
+    next_source.reset();
+    {
+        std::lock_guard<std::mutex> lock(next_mutex);
+        next_path.clear();
+        next_source_path.clear();
+    }
+    next_changed = false;
+    boundary_pending = false;
+    seek_request = -1;
+    seek_pending = false;
+    buffering_state = false;
+    active_rate = 0;
+    active_channels = 0;
+}
+
+// Connect the stream once, inactive, offering only the device format
+bool PlaybackEngine::connect_stream() {
+    // Setup audio format
+    uint8_t buffer[1024];
+    struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+    const struct spa_pod *params[1];
+    
+    struct spa_audio_info_raw spa_audio_info = {};
+    spa_audio_info.format = SPA_AUDIO_FORMAT_F32;
+    spa_audio_info.rate = device_rate;
+    spa_audio_info.channels = device_channels;
+    
+    // Set channel positions
+    std::vector<ChannelPosition> layout = default_channel_layout(device_channels);
+    for (int i = 0; i < device_channels; ++i) {
+        spa_audio_info.position[i] = spa_channel_position(layout[i]);
+    }
+    
+    params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &spa_audio_info);
+
+    pw_thread_loop_lock(loop);
+    int res = pw_stream_connect(stream,
+                                PW_DIRECTION_OUTPUT,
+                                PW_ID_ANY,
+                                static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT |
+                                                             PW_STREAM_FLAG_INACTIVE |
+                                                             PW_STREAM_FLAG_MAP_BUFFERS |
+                                                             PW_STREAM_FLAG_RT_PROCESS),
+                                params, 1);
+    pw_thread_loop_unlock(loop);
+
+    connected = (res >= 0);
+    return connected;
+}
+
+bool PlaybackEngine::play(const std::string& file_path) {
+    if (!loop) return false;
+
+    // Open the next file before touching the current one so the only gap
+    // between tracks is this call
+    std::unique_ptr<AudioSource> next = open_audio_source(file_path);
+    return play_source(std::move(next), gain_lookup ? gain_lookup(file_path) : 1.0f);
+}
+
+bool PlaybackEngine::play(std::unique_ptr<AudioSource> next) {
+    if (!loop) return false;
+    return play_source(std::move(next), gain_lookup ? gain_lookup(std::string()) : 1.0f);
+}
+
+bool PlaybackEngine::play_source(std::unique_ptr<AudioSource> next, float gain) {
+
+    std::lock_guard<std::mutex> lock(control_mutex);
+    detach_source();
+    if (!next) {
+        if (connected) {
+            pw_thread_loop_lock(loop);
+            pw_stream_set_active(stream, false);
+            pw_thread_loop_unlock(loop);
+        }
+        return false;
+    }
+
+    source = std::move(next);
+    decode_gain = gain;
+    if (!converter.matches(source->rate(), source->channels())) {
+        converter.configure(source->rate(), source->channels(), device_rate, device_channels);
+    } else {
+        converter.reset();
+    }
+    convert_ns = 0;
+    converted_frames = 0;
+
+    // Progress counts device frames; the decoder keeps source frames
+    total_frames = converter.output_frames(source->frames());
+    current_frame = 0;
+    underrun_count = 0;
+    decode_pos = 0;
+    decode_total = source->frames();
+    
+    // Start decoding ahead before the stream asks for its next buffer
+    int ring_ms = source->streaming() ? std::max(ring_buffer_ms, STREAM_RING_MS) : ring_buffer_ms;
+    size_t ring_frames = static_cast<size_t>(device_rate) * ring_ms / 1000;
+    ring.reset(ring_frames, device_channels);
+    max_watermark_frames = ring.capacity * 3 / 4;
+    watermark_frames = std::min(static_cast<size_t>(device_rate) * start_buffer_ms / 1000, max_watermark_frames);
+    buffering_state = true;
+    rebuffer_count = 0;
+    rt_telemetry.reset_ring_min();
+    decoder_thread = std::thread(&PlaybackEngine::decoder_loop, this);
+
+    active_rate = device_rate;
+    active_channels = device_channels;
+    source_active = true;
+
+    pw_thread_loop_lock(loop);
+    pw_stream_set_active(stream, true);
+    pw_thread_loop_unlock(loop);
+    return true;
+}
+
+int PlaybackEngine::buffered_ms() const {
+    int rate = active_rate.load();
+    return rate > 0 ? static_cast<int>(ring.readable() * 1000 / rate) : 0;
+}
+
+int PlaybackEngine::buffer_target_ms() const {
+    int rate = active_rate.load();
+    return rate > 0 ? static_cast<int>(watermark_frames.load() * 1000 / rate) : 0;
+}
+
+double PlaybackEngine::conversion_load() const {
+    uint64_t frames = converted_frames.load();
+    if (frames == 0 || device_rate <= 0) return 0.0;
+    return static_cast<double>(convert_ns.load()) * device_rate / (static_cast<double>(frames) * 1e9);
+}
+
+void PlaybackEngine::seek(sf_count_t frame) {
+    if (!source_active) return;
+    seek_request = std::max<sf_count_t>(0, frame);
+}
+
+void PlaybackEngine::set_next(const std::string& file_path) {
+    std::lock_guard<std::mutex> lock(next_mutex);
+    next_path = file_path;
+    next_changed = true;
+}
+
+std::string PlaybackEngine::spliced_path() const {
+    std::lock_guard<std::mutex> lock(next_mutex);
+    return spliced;
+}
+
+void PlaybackEngine::stop() {
+    std::lock_guard<std::mutex> lock(control_mutex);
+    detach_source();
+
+    if (connected) {
+        pw_thread_loop_lock(loop);
+        pw_stream_set_active(stream, false);
+        pw_thread_loop_unlock(loop);
+    }
+}
+
+bool PlayAudio(const std::string& file_path) {
+    return g_engine.play(file_path);
+}
+
+bool PlayAudio(std::unique_ptr<AudioSource> source) {
+    return g_engine.play(std::move(source));
+}
+
+void StopAudio() {
+    is_playing = false;
+    is_paused = false;
+
+    g_engine.stop();
+    
+    total_frames = 0;
+    current_frame = 0;
+    underrun_count = 0;
+}
+
+TelemetryDump::TelemetryDump(PlaybackEngine& engine, const std::string& path, int interval_ms)
+    : engine(engine), interval(std::chrono::milliseconds(std::max(10, interval_ms))) {
+    file = fopen(path.c_str(), "a");
+    if (!file) return;
+    engine.telemetry().acquire();
+    thread = std::thread(&TelemetryDump::run, this);
+}
+
+TelemetryDump::~TelemetryDump() {
+    if (!file) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+    engine.telemetry().release();
+    fclose(file);
+}
+
+void TelemetryDump::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!cv.wait_for(lock, interval, [this] { return stopping; })) {
+        write_line(engine.telemetry().snapshot());
+    }
+}
+
+void TelemetryDump::write_line(const AudioTelemetry::Snapshot& s) {
+    int rate = engine.sample_rate();
+    auto ms = [rate](size_t frames) { return rate > 0 ? static_cast<long long>(frames * 1000 / rate) : 0LL; };
+    long long now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    fprintf(file,
+            "{\"ts_ms\":%lld,\"callbacks\":%llu,\"frames_requested\":%llu,\"frames_delivered\":%llu,"
+            "\"short_callbacks\":%llu,\"out_of_buffers\":%llu,\"underruns\":%llu,\"rebuffers\":%llu,"
+            "\"quantum\":%u,\"rate\":%d,\"buffering\":%s,\"ring_fill_frames\":%zu,"
+            "\"ring_fill_ms\":%lld,\"ring_min_fill_ms\":%lld,\"callback_p50_us\":%llu,"
+            "\"callback_p99_us\":%llu,\"callback_max_us\":%llu,\"callback_us_histogram\":[",
+            now_ms, static_cast<unsigned long long>(s.callbacks),
+            static_cast<unsigned long long>(s.frames_requested),
+            static_cast<unsigned long long>(s.frames_delivered),
+            static_cast<unsigned long long>(s.short_callbacks),
+            static_cast<unsigned long long>(s.out_of_buffers),
+            static_cast<unsigned long long>(underrun_count.load()),
+            static_cast<unsigned long long>(engine.rebuffers()),
+            s.quantum, rate, engine.buffering() ? "true" : "false", s.ring_fill,
+            ms(s.ring_fill), ms(s.ring_min_fill),
+            static_cast<unsigned long long>(s.percentile_us(0.5)),
+            static_cast<unsigned long long>(s.percentile_us(0.99)),
+            static_cast<unsigned long long>(s.max_duration_ns / 1000));
+    for (int i = 0; i < AudioTelemetry::HISTOGRAM_BUCKETS; ++i) {
+        fprintf(file, i ? ",%llu" : "%llu", static_cast<unsigned long long>(s.histogram[i]));
+    }
+    fputs("]}\n", file);
+    fflush(file);
+}
@@ -0,0 +1,1008 @@
+#pragma once
+// Audio engine: sources, format conversion and PipeWire output
+
+#include "common.h"
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h> // for the resampler
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// For Audio Playback (using PipeWire)
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+
+// For Audio File Decoding (using libsndfile)
+#include <sndfile.h>
+
+// For Streaming and Container Decoding (using FFmpeg)
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswresample/swresample.h>
+}
+
+// --- Seek Tables ---
+//
+// Streams without a container index (MP3, ADTS AAC) can only be seeked by
+// byte offset, and a bitrate guess lands anywhere on VBR files. A seek
+// table maps source frames to the byte offsets of packets at least
+// SEEK_TABLE_INTERVAL_MS apart, so a seek decodes at most one interval.
+// It is extended lazily, for free during playback and by a demux-only scan
+// when a seek lands past its end, and cached next to the library index as
+// seek-<hash>.tbl, invalidated by the file's size or mtime.
+
+const char SEEK_TABLE_MAGIC[8] = {'U', 'W', 'U', 'S', 'E', 'E', 'K', '\0'};
+const uint32_t SEEK_TABLE_VERSION = 1;
+const int SEEK_TABLE_INTERVAL_MS = 1000;
+
+struct SeekPoint {
+    int64_t frame;  // first source frame decoded from the packet
+    int64_t offset; // byte offset of the packet in the file
+};
+
+struct SeekTableHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sample_rate;
+    uint64_t file_size;
+    int64_t mtime;
+    uint64_t count;
+    uint32_t complete;
+    uint32_t reserved;
+};
+
+class SeekTable {
+public:
+    // Load the cached table for the audio file at path, if it still matches
+    SeekTable(const std::string& path, int sample_rate);
+
+    ~SeekTable() { save(); }
+
+    SeekTable(const SeekTable&) = delete;
+    SeekTable& operator=(const SeekTable&) = delete;
+
+    // Record the packet at offset starting at frame; keeps one per interval
+    void add(int64_t frame, int64_t offset);
+
+    // Last point at or before frame, null if there is none
+    const SeekPoint* find(int64_t frame) const;
+
+    const SeekPoint* last() const { return points.empty() ? nullptr : &points.back(); }
+
+    // Every packet up to the end of the file has been seen
+    bool finished() const { return complete; }
+    void mark_finished();
+
+    // Publish atomically (temp + rename); a read-only cache just skips it
+    void save();
+
+private:
+    void load();
+
+    std::string table_path;
+    uint32_t rate;
+    int64_t interval;
+    uint64_t file_size = 0;
+    int64_t mtime = 0;
+
+    std::vector<SeekPoint> points; // ascending in both frame and offset
+    bool complete = false;
+    bool dirty = false;
+};
+
+// Global atomic flags and variables for playback control and progress
+extern std::atomic<bool> is_playing;
+extern std::atomic<bool> is_paused;
+extern std::atomic<sf_count_t> total_frames;
+extern std::atomic<sf_count_t> current_frame;
+extern std::atomic<uint64_t> underrun_count;
+
+// Decode-ahead depth in milliseconds of audio (override with UWU_RING_MS).
+// Larger values ride out longer disk stalls at the cost of memory.
+extern int ring_buffer_ms;
+
+// Network streams get a deeper ring to ride out connection stalls
+const int STREAM_RING_MS = 8000;
+
+// Output starts once this much audio is decoded (override with
+// UWU_START_MS). Every underrun doubles the watermark used to resume, up
+// to three quarters of the ring, so a flaky source rebuffers less often.
+extern int start_buffer_ms;
+
+// Frames decoded per AudioSource::read call on the decoder thread
+const sf_count_t DECODE_CHUNK_FRAMES = 4096;
+
+// Gapless playback: splice the queued next track into the same ring
+// (disable with UWU_GAPLESS=0). The next file is opened once the current
+// one has less than GAPLESS_PREOPEN_MS left to decode, and its first
+// GAPLESS_PREROLL_MS are decoded up front so the splice never waits on I/O.
+extern bool gapless_enabled;
+const int GAPLESS_PREOPEN_MS = 3000;
+const int GAPLESS_PREROLL_MS = 300;
+
+// Single-producer/single-consumer lock-free ring of interleaved float frames.
+// The decoder thread is the only writer, on_process the only reader.
+// Positions count frames monotonically and are wrapped on access.
+struct FrameRing {
+    std::vector<float> samples;
+    size_t capacity = 0; // in frames
+    int channels = 0;
+
+    alignas(64) std::atomic<size_t> write_pos{0};
+    alignas(64) std::atomic<size_t> read_pos{0};
+
+    void reset(size_t frames, int ch) {
+        capacity = std::max<size_t>(frames, 1);
+        channels = ch;
+        samples.assign(capacity * channels, 0.0f);
+        write_pos = 0;
+        read_pos = 0;
+    }
+
+    size_t readable() const {
+        return write_pos.load(std::memory_order_acquire) - read_pos.load(std::memory_order_relaxed);
+    }
+
+    // Absolute positions as seen by their owning side
+    size_t produced() const { return write_pos.load(std::memory_order_relaxed); }
+    size_t consumed() const { return read_pos.load(std::memory_order_relaxed); }
+
+    // Contiguous free region for the producer; returns its length in frames
+    size_t write_region(float** ptr) {
+        size_t w = write_pos.load(std::memory_order_relaxed);
+        size_t r = read_pos.load(std::memory_order_acquire);
+        size_t free_frames = capacity - (w - r);
+        size_t offset = w % capacity;
+        *ptr = samples.data() + offset * channels;
+        return std::min(free_frames, capacity - offset);
+    }
+
+    void commit_write(size_t frames) {
+        write_pos.store(write_pos.load(std::memory_order_relaxed) + frames, std::memory_order_release);
+    }
+
+    // Copy up to `frames` frames into dst; returns the number copied
+    size_t read(float* dst, size_t frames) {
+        size_t r = read_pos.load(std::memory_order_relaxed);
+        size_t w = write_pos.load(std::memory_order_acquire);
+        size_t n = std::min(frames, w - r);
+        size_t offset = r % capacity;
+        size_t first = std::min(n, capacity - offset);
+        memcpy(dst, samples.data() + offset * channels, first * channels * sizeof(float));
+        if (n > first) {
+            memcpy(dst + first * channels, samples.data(), (n - first) * channels * sizeof(float));
+        }
+        read_pos.store(r + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer side: drop everything before absolute position pos
+    void discard_to(size_t pos) {
+        if (pos > read_pos.load(std::memory_order_relaxed)) {
+            read_pos.store(pos, std::memory_order_release);
+        }
+    }
+};
+
+// --- Stream Cache ---
+
+// Downloads are tracked in pieces of this size: a .part carries a bitmap
+// of the pieces on disk, and a read past them fetches from its own piece
+const int64_t STREAM_CHUNK_BYTES = 256 * 1024;
+
+// Owns the downloaded streams in the cache directory. It enforces a byte
+// budget (UWU_CACHE_MB) by evicting the least recently used entries, and it
+// records what makes an entry valid. Streams are written to <name>.part and
+// published by rename once complete. The index notes each entry's expected
+// size, so a truncated file is never played. A .part of known size is
+// sparse and filled in any order; <name>.part.map says which chunks hold
+// data, so an interrupted download is resumed chunk by chunk and a .part
+// without its map is never trusted.
+//
+// Index file (text, one entry per line, rewritten atomically):
+//   <complete 0|1> <size> <expected> <last_used unix seconds> <name>
+// Chunk map (native endianness, replaced atomically):
+//   StreamChunkHeader, then uint64_t words, bit i set once chunk i is durable
+const char STREAM_CHUNK_MAGIC[8] = {'U', 'W', 'U', 'C', 'H', 'U', 'N', 'K'};
+const uint32_t STREAM_CHUNK_VERSION = 1;
+
+struct StreamChunkHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunk_bytes;
+    int64_t length;
+};
+
+class StreamCache {
+public:
+    // Containers a stream may be stored in. "mp3" is only ever found from
+    // the old re-encoding pipeline, and such files are never trusted.
+    static constexpr const char* EXTENSIONS[] = {"m4a", "webm", "opus", "mp3"};
+
+    StreamCache(std::string dir, int64_t budget_bytes);
+
+    StreamCache(const StreamCache&) = delete;
+    StreamCache& operator=(const StreamCache&) = delete;
+
+    const std::string& dir() const { return cache_dir; }
+    std::string path(const std::string& name) const { return cache_dir + "/" + name; }
+
+    // Path of a complete copy of video_id, marked as just used; empty if
+    // there is none. An entry whose file no longer matches is dropped.
+    std::string lookup(const std::string& video_id);
+
+    // Whether a complete copy exists, without touching its recency
+    bool contains(const std::string& video_id);
+
+    // Chunk map an earlier attempt at <name> left for a download of
+    // `length` bytes. False, with `chunks` cleared, if there is none that
+    // fits: the .part is then refetched from scratch.
+    bool load_chunks(const std::string& name, int64_t length, std::vector<uint64_t>& chunks);
+
+    // Replace the chunk map of <name>.part. The data it vouches for must
+    // already be on disk (fdatasync'd), or a crash could leave holes
+    // marked as present.
+    void save_chunks(const std::string& name, int64_t length, const std::vector<uint64_t>& chunks);
+
+    // A download of `expected` bytes (-1 if unknown) is writing <name>.part;
+    // it is exempt from eviction until publish() or abandon()
+    void begin(const std::string& name, int64_t expected);
+
+    // <name>.part was renamed to <name> after `size` bytes
+    void publish(const std::string& name, int64_t size);
+
+    // The download stopped with `bytes` in <name>.part. The partial file is
+    // kept for resuming if its final size is known and its chunk map was
+    // saved, otherwise deleted.
+    void abandon(const std::string& name, int64_t bytes);
+
+private:
+    struct Entry {
+        bool complete = false;
+        int64_t size = 0;      // bytes on disk (reserved while downloading)
+        int64_t expected = -1; // final size, -1 if unknown
+        int64_t last_used = 0;
+        bool pinned = false;   // being written; not persisted
+    };
+
+    static constexpr const char* INDEX_NAME = "streams.index";
+
+    std::string map_path(const std::string& name) const { return path(name + ".part.map"); }
+
+    // <id>.<ext> or <id>.<ext>.part for one of EXTENSIONS
+    static bool managed_name(const std::string& file, std::string& name, bool& partial);
+
+    void load_locked();
+
+    // Make the index agree with the directory. Complete files the index
+    // can't vouch for (e.g. written by an interrupted older version) are
+    // deleted rather than trusted, and so are partials that can't resume:
+    // those of unknown size, without a chunk map or grown past their size.
+    void reconcile_locked();
+
+    void remove_locked(std::unordered_map<std::string, Entry>::iterator it);
+
+    // Drop least recently used entries until the budget holds
+    void evict_locked();
+
+    void save_locked();
+
+    std::string cache_dir;
+    int64_t budget;
+    int64_t total = 0;
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+};
+
+// Byte budget of the stream cache in MiB (override with UWU_CACHE_MB, 0 for
+// no limit)
+extern int cache_budget_mb;
+
+// --- Format Conversion ---
+
+// Device format the engine outputs for every track (override with UWU_RATE
+// and UWU_CHANNELS). The stream is negotiated once with it at startup;
+// sources are converted to it on the decoder thread.
+extern int output_rate;
+extern int output_channels;
+
+// Polyphase filter length per output sample when resampling up; scaled up
+// with the decimation factor when resampling down
+const int RESAMPLER_TAPS = 32;
+const int RESAMPLER_MAX_TAPS = 256;
+const int RESAMPLER_MAX_PHASES = 1024;
+
+// Speaker positions, in the default order WAV/FLAC/FFmpeg use for each
+// channel count
+enum ChannelPosition { CH_MONO, CH_FL, CH_FR, CH_FC, CH_LFE, CH_BL, CH_BR, CH_SL, CH_SR, CH_BC, CH_NONE };
+
+std::vector<ChannelPosition> default_channel_layout(int channels);
+
+uint32_t spa_channel_position(ChannelPosition position);
+
+// Sum of a[i] * b[i]; the resampler's entire inner loop
+inline float dot_product(const float* a, const float* b, int n) {
+    int i = 0;
+    float sum = 0.0f;
+#if defined(__AVX__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+#if defined(__FMA__)
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+#else
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+#endif
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    sum = _mm_cvtss_f32(half);
+#elif defined(__SSE__)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    sum = _mm_cvtss_f32(acc);
+#elif defined(__ARM_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; i + 4 <= n; i += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    sum = vaddvq_f32(acc);
+#endif
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// Per-track gain, in place. Unity gain and cuts are plain scaling, so a
+// track's own peaks are never touched. A boost goes through a soft
+// limiter: samples stay linear up to SOFT_LIMIT_THRESHOLD and above it
+// bend smoothly towards full scale (a + e*k/(k+e) for an excess e over
+// threshold a, k = 1 - a), so it never clips. Memoryless: no lookahead,
+// no state across buffers or tracks.
+const float SOFT_LIMIT_THRESHOLD = 0.8f; // about -2 dBFS
+
+inline void apply_gain_limited(float* samples, size_t n, float gain) {
+    if (gain <= 1.0f) {
+        if (gain == 1.0f) return;
+        for (size_t i = 0; i < n; ++i) samples[i] *= gain;
+        return;
+    }
+
+    const float t = SOFT_LIMIT_THRESHOLD;
+    const float k = 1.0f - SOFT_LIMIT_THRESHOLD;
+    size_t i = 0;
+#if defined(__AVX__)
+    const __m256 g8 = _mm256_set1_ps(gain), t8 = _mm256_set1_ps(t), k8 = _mm256_set1_ps(k);
+    const __m256 sign8 = _mm256_set1_ps(-0.0f), zero8 = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(samples + i), g8);
+        __m256 a = _mm256_andnot_ps(sign8, x);
+        __m256 e = _mm256_max_ps(_mm256_sub_ps(a, t8), zero8);
+        __m256 y = _mm256_add_ps(_mm256_min_ps(a, t8),
+                                 _mm256_div_ps(_mm256_mul_ps(e, k8), _mm256_add_ps(k8, e)));
+        _mm256_storeu_ps(samples + i, _mm256_or_ps(y, _mm256_and_ps(sign8, x)));
+    }
+#elif defined(__SSE__)
+    const __m128 g4 = _mm_set1_ps(gain), t4 = _mm_set1_ps(t), k4 = _mm_set1_ps(k);
+    const __m128 sign4 = _mm_set1_ps(-0.0f), zero4 = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(samples + i), g4);
+        __m128 a = _mm_andnot_ps(sign4, x);
+        __m128 e = _mm_max_ps(_mm_sub_ps(a, t4), zero4);
+        __m128 y = _mm_add_ps(_mm_min_ps(a, t4), _mm_div_ps(_mm_mul_ps(e, k4), _mm_add_ps(k4, e)));
+        _mm_storeu_ps(samples + i, _mm_or_ps(y, _mm_and_ps(sign4, x)));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t g4 = vdupq_n_f32(gain), t4 = vdupq_n_f32(t), k4 = vdupq_n_f32(k);
+    const uint32x4_t sign4 = vdupq_n_u32(0x80000000u);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t x = vmulq_f32(vld1q_f32(samples + i), g4);
+        float32x4_t a = vabsq_f32(x);
+        float32x4_t e = vmaxq_f32(vsubq_f32(a, t4), vdupq_n_f32(0.0f));
+        float32x4_t y = vaddq_f32(vminq_f32(a, t4), vdivq_f32(vmulq_f32(e, k4), vaddq_f32(k4, e)));
+        vst1q_f32(samples + i, vbslq_f32(sign4, x, y));
+    }
+#endif
+    for (; i < n; ++i) {
+        float x = samples[i] * gain;
+        float a = std::fabs(x);
+        float e = std::max(a - t, 0.0f);
+        samples[i] = std::copysign(std::min(a, t) + e * k / (k + e), x);
+    }
+}
+
+// Converts decoded audio to the device format: a channel matrix (remap,
+// mono spread, ITU-style downmix with per-output normalisation) followed,
+// when the rates differ, by a polyphase Kaiser-windowed sinc resampler for
+// the exact rational ratio. Filter state carries across process() calls,
+// so consecutive tracks at the same rate join without a seam.
+class FormatConverter {
+public:
+    void configure(int in_rate, int in_ch, int out_rate, int out_ch);
+
+    bool matches(int in_rate, int in_ch) const;
+
+    // Output frames for `frames` input frames, for progress bookkeeping
+    sf_count_t output_frames(sf_count_t frames) const;
+
+    // Just under half a filter of leading silence centres the first output
+    // on the first input frame, so the resampler adds no delay
+    void reset();
+
+    // Drain the frames still held in the filter at end of stream
+    void flush(std::vector<float>& out);
+
+    // Append the device-format frames for `frames` interleaved input frames
+    void process(const float* in, size_t frames, std::vector<float>& out);
+
+private:
+    void build_matrix();
+
+    void remap(const float* in, size_t frames, float* out) const;
+
+    static double bessel_i0(double x);
+
+    // Prototype low-pass at interp x input rate, cut off just below the
+    // lower Nyquist, split into `interp` phases of `taps` coefficients
+    // stored reversed so each output is one forward dot product
+    void design_filter();
+
+    int input_rate = 0;
+    int input_channels = 0;
+    int output_rate_hz = 0;
+    int output_ch = 0;
+
+    std::vector<float> matrix; // output_ch x input_channels
+    bool identity = false;
+
+    bool resampling = false;
+    int interp = 1;
+    int decim = 1;
+    int taps = 0;
+    int phase = 0;
+    std::vector<float> filters;
+    std::vector<std::vector<float>> history;
+};
+
+// --- Telemetry ---
+
+// Counters kept by on_process for diagnosing glitches. The RT thread is
+// the only writer: every update is a relaxed store or increment and
+// nothing blocks. While no reader has acquire()d it, a callback pays a
+// single relaxed load.
+class AudioTelemetry {
+public:
+    // Callback durations in power-of-two microsecond buckets: bucket 0 is
+    // under 1 us, bucket i covers [2^(i-1), 2^i) us, the last is open
+    static const int HISTOGRAM_BUCKETS = 16;
+
+    void acquire() { users++; }
+    void release() { users--; }
+    bool enabled() const { return users.load(std::memory_order_relaxed) > 0; }
+
+    // One process() call: `requested` frames asked for, `delivered` of
+    // them real audio (the rest silence), `fill` frames left in the ring
+    void record(uint64_t duration_ns, uint32_t requested, uint32_t delivered, size_t fill, bool playing);
+
+    // Counted whether or not anyone is watching; it is already a failure path
+    void missed_buffer() { bump(out_of_buffers); }
+
+    // Low-water mark of the ring restarts with every track
+    void reset_ring_min() { ring_min_fill.store(SIZE_MAX, std::memory_order_relaxed); }
+
+    struct Snapshot {
+        uint64_t callbacks = 0;
+        uint64_t frames_requested = 0;
+        uint64_t frames_delivered = 0;
+        uint64_t short_callbacks = 0;
+        uint64_t out_of_buffers = 0;
+        uint32_t quantum = 0;
+        size_t ring_fill = 0;
+        size_t ring_min_fill = 0;
+        uint64_t max_duration_ns = 0;
+        std::array<uint64_t, HISTOGRAM_BUCKETS> histogram{};
+
+        // Upper bound of the bucket holding quantile q of callbacks, in us
+        uint64_t percentile_us(double q) const;
+    };
+
+    // Counters are read individually, so a snapshot taken mid-callback may
+    // be one callback apart between fields
+    Snapshot snapshot() const;
+
+private:
+    // Single writer, so load + store instead of a locked read-modify-write
+    template <typename T>
+    static void add(std::atomic<T>& counter, T n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    static void bump(std::atomic<uint64_t>& counter) { add<uint64_t>(counter, 1); }
+
+    std::atomic<int> users{0};
+
+    alignas(64) std::atomic<uint64_t> callbacks{0};
+    std::atomic<uint64_t> frames_requested{0};
+    std::atomic<uint64_t> frames_delivered{0};
+    std::atomic<uint64_t> short_callbacks{0};
+    std::atomic<uint64_t> out_of_buffers{0};
+    std::atomic<uint32_t> quantum{0};
+    std::atomic<size_t> ring_fill{0};
+    std::atomic<size_t> ring_min_fill{SIZE_MAX};
+    std::atomic<uint64_t> max_duration_ns{0};
+    std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> histogram{};
+};
+
+// Copy of what on_process hands to PipeWire, for visualisers. Holds the
+// newest CAPACITY frames of the first two channels (mono is doubled) and
+// is written only while someone holds acquire(). The writer never waits:
+// it overwrites the oldest frames, and a reader that may have been lapped
+// while copying gets a failed read_latest() and tries on its next tick.
+class OutputTap {
+public:
+    static constexpr size_t CAPACITY = 8192; // frames, a power of two
+    static constexpr int CHANNELS = 2;
+    // Largest push and largest read: together they fit the ring, so a
+    // read that saw the writer move less than this apart is intact
+    static constexpr size_t WINDOW = CAPACITY / 2;
+
+    void acquire() { users++; }
+    void release() { users--; }
+    bool enabled() const { return users.load(std::memory_order_relaxed) > 0; }
+
+    // RT thread: a plain copy, keeping the newest WINDOW frames of a
+    // larger quantum
+    void push(const float* frames, size_t count, int channels);
+
+    // Frames pushed so far
+    uint64_t position() const { return written.load(std::memory_order_acquire); }
+
+    // Copy the newest `count` frames (at most WINDOW, interleaved stereo)
+    // into out, zero-padded before the first push. Returns the position
+    // they end at, or 0 if nothing was pushed yet or the writer may have
+    // overwritten them mid-copy.
+    uint64_t read_latest(float* out, size_t count) const;
+
+private:
+    std::atomic<int> users{0};
+    std::atomic<uint64_t> written{0};
+    std::array<float, CAPACITY * CHANNELS> samples{};
+};
+
+// --- Audio Sources ---
+
+// Producer of decoded interleaved float frames, pulled by the engine's
+// decoder thread. Implementations only need to be safe for one reader;
+// interrupt() may be called from any thread to unblock a pending read.
+class AudioSource {
+public:
+    virtual ~AudioSource() = default;
+
+    // Decode up to `frames` frames into dst; fewer means end of stream
+    virtual sf_count_t read(float* dst, sf_count_t frames) = 0;
+    // Make the next read start exactly at `frame`; false if not possible
+    virtual bool seek(sf_count_t frame) { (void)frame; return false; }
+    virtual void interrupt() {}
+    // True for sources fed over the network
+    virtual bool streaming() const { return false; }
+
+    int rate() const { return sample_rate; }
+    int channels() const { return channel_count; }
+    // Total length in frames, 0 if the container doesn't say
+    sf_count_t frames() const { return frame_count; }
+
+protected:
+    int sample_rate = 0;
+    int channel_count = 0;
+    sf_count_t frame_count = 0;
+};
+
+// Serve library files to libsndfile straight from the page cache through
+// a read-only mapping (disable with UWU_MMAP=0)
+extern bool mmap_enabled;
+
+// Pacing shared by background transfers: each caller reserves its bytes on
+// a virtual clock advancing at `rate` bytes per second and sleeps until its
+// slot. Up to a second of unused allowance may be spent as a burst.
+class RateLimiter {
+public:
+    explicit RateLimiter(int64_t bytes_per_second) : rate(bytes_per_second) {}
+
+    void acquire(int64_t bytes, const std::atomic<bool>& cancel);
+
+private:
+    int64_t rate;
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point next_free;
+};
+
+// One HTTP fetch of a stream's original container bytes into the cache
+// as `<name>.part`, published as `<name>` once complete. When the server
+// sends a Content-Length the file is fetched in STREAM_CHUNK_BYTES pieces
+// with range requests: forward from where the reader is, then round to
+// the holes before it. Chunks an earlier attempt left are kept. Readers
+// block until the bytes they ask for have arrived, so decoding can start
+// with the first packet instead of the whole file, and a read far from
+// the chunk being fetched (a seek, a container index at the end) moves
+// the fetch there.
+class StreamDownload {
+public:
+    StreamDownload(std::string url, StreamCache& cache, std::string name);
+
+    ~StreamDownload();
+
+    StreamDownload(const StreamDownload&) = delete;
+    StreamDownload& operator=(const StreamDownload&) = delete;
+
+    void start() { thread = std::thread(&StreamDownload::run, this); }
+
+    void cancel();
+
+    // Pace the transfer through limiter (shared with other downloads);
+    // null lifts the cap from the next chunk on
+    void set_rate_limit(RateLimiter* limiter) { rate_limit = limiter; }
+
+    // Block until the download completed, failed or was cancelled
+    void wait();
+
+    // Blocking positional read. Returns the bytes copied, 0 at the end of
+    // the stream, -1 if the bytes can't arrive any more (the download
+    // failed or was cancelled) or `interrupt` is set.
+    ssize_t read_at(int64_t offset, void* dst, size_t len, const std::atomic<bool>& interrupt);
+
+    // Content-Length, or -1 if the server didn't send one
+    int64_t size() const { return length.load(); }
+    int64_t downloaded() const { return received.load(); }
+    // Where the file lands in the cache once finished
+    const std::string& path() const { return final_path; }
+    bool finished() const { return done.load() && !failed.load(); }
+    bool has_failed() const { return failed.load(); }
+
+private:
+    static const int READ_BYTES = 64 * 1024;
+    // A read this many chunks past the one being fetched waits for it to
+    // get there; further away, a new range request is quicker
+    static const int64_t JUMP_CHUNKS = 2;
+    // The chunk map is saved after this many new chunks and at the end
+    static const int MAP_SAVE_CHUNKS = 16;
+
+    static int check_cancel(void* opaque);
+
+    bool has_chunk_locked(int64_t chunk) const;
+
+    // Bytes at offset that are on disk, up to the end of their chunk
+    int64_t readable_locked(int64_t offset) const;
+
+    // Point the fetch at offset unless it is about to get there anyway
+    void request_locked(int64_t offset);
+
+    // First missing chunk at or after `from`, wrapping round; -1 if none
+    int64_t next_missing_locked(int64_t from) const;
+
+    bool write_at(const unsigned char* data, int64_t bytes, int64_t offset);
+
+    // Durable before recorded: the map only ever names bytes on disk
+    void save_chunks();
+
+    // Known length: chunk by chunk with range requests. True once every
+    // chunk is on disk.
+    bool fetch_chunks(AVIOContext* http);
+
+    // Unknown length: one pass front to back, nothing to resume from
+    bool fetch_sequential(AVIOContext* http);
+
+    void run();
+
+    std::string url;
+    StreamCache& cache;
+    std::string name;
+    std::string final_path;
+    std::string part_path;
+    int fd = -1;
+
+    // Bytes on disk: whole chunks, or the prefix when the length is unknown
+    std::atomic<int64_t> received{0};
+    std::atomic<int64_t> length{-1};
+    std::atomic<bool> done{false};
+    std::atomic<bool> failed{false};
+    std::atomic<bool> cancelled{false};
+    std::atomic<RateLimiter*> rate_limit{nullptr};
+
+    // Chunk state, under mutex. The chunk being fetched can be read up to
+    // filling_bytes before it is complete; wanted_chunk is where a reader
+    // asked the fetch to go next (-1 for nowhere in particular).
+    std::vector<uint64_t> chunks;
+    int64_t chunk_count = 0;
+    int64_t filling_chunk = -1;
+    int64_t filling_bytes = 0;
+    int64_t wanted_chunk = -1;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread thread;
+};
+
+// Decodes whatever libavformat can demux (m4a/AAC, webm/Opus, ...) into
+// interleaved float at the stream's own rate and channel count. Bytes come
+// from a local file or from a StreamDownload that may still be growing.
+class LibavSource : public AudioSource {
+public:
+    static std::unique_ptr<AudioSource> open_file(const std::string& path);
+
+    // Blocks until the container header and first packets have arrived
+    static std::unique_ptr<AudioSource> open_stream(std::shared_ptr<StreamDownload> download);
+
+    ~LibavSource() override;
+
+    sf_count_t read(float* dst, sf_count_t frames) override;
+
+    // Containers with an index (MP4, Matroska, Ogg) seek by timestamp;
+    // index-less streams go through the seek table. Either way decoding
+    // restarts a little early and the frames before `target` are dropped.
+    bool seek(sf_count_t target) override;
+
+    void interrupt() override { interrupted = true; }
+    bool streaming() const override { return download != nullptr; }
+
+private:
+    static const int IO_BUFFER_BYTES = 64 * 1024;
+
+    // Decoded ahead of a seek target so MP3's bit reservoir is refilled
+    static const int SEEK_PREROLL_MS = 100;
+
+    LibavSource() = default;
+
+    bool open(const char* url);
+
+    // Decode the next frame of our stream into `pending`
+    bool decode_next();
+
+    // Stream timestamp to source frames counted from the first decoded one
+    sf_count_t to_frames(int64_t pts) const;
+
+    bool seek_to_timestamp(sf_count_t target);
+
+    bool seek_with_table(sf_count_t target);
+
+    // Demux without decoding from the last known point until `aim` is
+    // covered, timing packets by their durations since byte-seeked packets
+    // carry no timestamps. A scan that reaches EOF completes the table.
+    void scan_to(sf_count_t aim);
+
+    static int read_packet(void* opaque, uint8_t* buf, int size);
+
+    static int64_t seek_packet(void* opaque, int64_t offset, int whence);
+
+    static int check_interrupt(void* opaque);
+
+    std::shared_ptr<StreamDownload> download;
+    int64_t io_pos = 0;
+    std::atomic<bool> interrupted{false};
+
+    AVFormatContext* format = nullptr;
+    AVIOContext* io = nullptr;
+    AVCodecContext* codec = nullptr;
+    SwrContext* swr = nullptr;
+    AVPacket* packet = nullptr;
+    AVFrame* frame = nullptr;
+    int stream_index = -1;
+    bool finished = false;
+    int64_t start_pts = 0;
+
+    // Seeking: the source frame of the next decoded frame (-1 when it has to
+    // come from timestamps), the frame a pending seek must start at, and
+    // whether packets still arrive in order from the top of the file
+    std::unique_ptr<SeekTable> seek_table;
+    sf_count_t position = 0;
+    sf_count_t seek_target = -1;
+    bool sequential = true;
+
+    // Converted frames of the last decoded AVFrame not yet handed out
+    std::vector<float> pending;
+    size_t pending_frames = 0;
+    size_t pending_pos = 0;
+};
+
+// libsndfile for the formats it knows, libavformat for everything else
+// (e.g. cached m4a/webm streams). MP3 goes to libavformat first: its packet
+// offsets feed the seek table, where sf_seek decodes VBR files from the top.
+std::unique_ptr<AudioSource> open_audio_source(const std::string& path);
+
+// Long-lived playback engine. One pw_thread_loop and one stream live for the
+// whole process; switching tracks only swaps the AudioSource and decoder
+// thread underneath. The stream is negotiated once at the device format and
+// the decoder converts every source to it, so a track switch never touches
+// the PipeWire graph.
+class PlaybackEngine {
+public:
+    bool start();
+    void shutdown();
+
+    // Open file_path and make it the current source. Returns false if the
+    // file could not be opened (current playback is stopped either way).
+    bool play(const std::string& file_path);
+    bool play(std::unique_ptr<AudioSource> next);
+    void stop();
+
+    // Linear gain for a track (empty path for streams), asked when a track
+    // starts or is pre-opened. Set once before start(); without it the
+    // float path is left untouched.
+    void set_gain_lookup(std::function<float(const std::string&)> lookup) { gain_lookup = std::move(lookup); }
+
+    // Track to splice in gaplessly when the current one ends; an empty path
+    // clears it. A different successor already pre-opened is dropped.
+    void set_next(const std::string& file_path);
+
+    // Bumped by on_process each time playback crosses into a spliced track
+    uint64_t track_changes() const { return track_change_count.load(); }
+
+    // Path of the track the latest splice switched to
+    std::string spliced_path() const;
+
+    // Jump to `frame` of the current track, in current_frame units. The
+    // decoder thread repositions the source; progress jumps once on_process
+    // has dropped the audio queued before the seek.
+    void seek(sf_count_t frame);
+
+    // Format of current_frame/total_frames and the ring: the device
+    // format while a track is loaded, 0 when idle
+    int sample_rate() const { return active_rate.load(); }
+    int channels() const { return active_channels.load(); }
+
+    // Share of real time the decoder spends converting to the device format
+    double conversion_load() const;
+
+    // RT callback counters; recording is on while anyone holds acquire()
+    AudioTelemetry& telemetry() { return rt_telemetry; }
+
+    // Output copy for visualisers, filled while anyone holds acquire()
+    OutputTap& output_tap() { return tap; }
+
+    // Readable whenever a track ends or changes, or buffering starts or ends
+    int event_fd() const { return notify_fd; }
+
+    // Output is held until the ring reaches the watermark, at start and
+    // after every underrun
+    bool buffering() const { return buffering_state.load(); }
+    int buffered_ms() const;
+    int buffer_target_ms() const;
+    uint64_t rebuffers() const { return rebuffer_count.load(); }
+
+private:
+    static void on_process(void* userdata);
+    static void on_param_changed(void* userdata, uint32_t id, const struct spa_pod* param);
+    static const struct pw_stream_events stream_events;
+
+    void process();
+    void notify();
+    void decoder_loop();
+    void apply_seek(sf_count_t frame);
+    bool play_source(std::unique_ptr<AudioSource> next, float gain);
+    bool convert_and_write(const float* frames, sf_count_t count, bool yield_to_seek = false);
+    bool flush_converter();
+    bool write_ring(const float* frames, size_t count, bool yield_to_seek);
+    void preopen_next();
+    bool splice_next();
+    void detach_source();
+    bool connect_stream();
+
+    struct pw_thread_loop* loop = nullptr;
+    struct pw_stream* stream = nullptr;
+    bool connected = false;
+    int device_rate = 0;
+    int device_channels = 0;
+
+    // Format PipeWire actually settled on; on_process emits silence until
+    // it matches the ring so a mismatched graph never garbles output
+    std::atomic<int> negotiated_channels{0};
+
+    std::unique_ptr<AudioSource> source;
+    std::atomic<int> active_rate{0};
+    std::atomic<int> active_channels{0};
+
+    // Decoder-thread conversion to the device format and its cost
+    FormatConverter converter;
+    std::vector<float> decoded;
+    std::vector<float> converted;
+    std::atomic<uint64_t> convert_ns{0};
+    std::atomic<uint64_t> converted_frames{0};
+
+    // Gain of the track being decoded, applied after conversion
+    std::function<float(const std::string&)> gain_lookup;
+    float decode_gain = 1.0f;
+
+    AudioTelemetry rt_telemetry;
+    OutputTap tap;
+
+    FrameRing ring;
+    std::thread decoder_thread;
+    std::atomic<bool> decoder_stop{false};
+    std::atomic<bool> decoder_eof{false};
+    sf_count_t decode_pos = 0;
+    sf_count_t decode_total = 0;
+
+    // Pre-opened next track, owned by the decoder thread while it runs
+    mutable std::mutex next_mutex;
+    std::string next_path;
+    std::atomic<bool> next_changed{false};
+    std::unique_ptr<AudioSource> next_source;
+    std::string next_source_path;
+    std::string spliced;
+    sf_count_t next_total = 0;
+    float next_gain = 1.0f;
+    std::vector<float> preroll;
+    sf_count_t preroll_frames = 0;
+
+    // Ring position where the spliced track starts; on_process switches
+    // progress over to it once its read position crosses that point
+    std::atomic<bool> boundary_pending{false};
+    std::atomic<size_t> boundary_pos{0};
+    std::atomic<sf_count_t> boundary_total{0};
+    std::atomic<uint64_t> track_change_count{0};
+
+    // Seek handoff: UI to decoder through seek_request (-1 when idle), then
+    // decoder to on_process, which drops the ring up to seek_pos and
+    // reports seek_frame as the new position
+    std::atomic<sf_count_t> seek_request{-1};
+    std::atomic<bool> seek_pending{false};
+    std::atomic<size_t> seek_pos{0};
+    std::atomic<sf_count_t> seek_frame{0};
+
+    // Handshake with the RT thread: the ring and source may only be
+    // replaced once source_active is false and no callback is in flight
+    std::atomic<bool> source_active{false};
+    std::atomic<int> in_process{0};
+
+    int notify_fd = -1;
+
+    std::atomic<bool> buffering_state{false};
+    std::atomic<size_t> watermark_frames{0};
+    size_t max_watermark_frames = 0;
+    std::atomic<uint64_t> rebuffer_count{0};
+
+    std::mutex control_mutex;
+};
+
+// Global playback engine
+extern PlaybackEngine g_engine;
+
+// Function to play audio through the engine (libsndfile or libav decoding)
+bool PlayAudio(const std::string& file_path);
+
+bool PlayAudio(std::unique_ptr<AudioSource> source);
+
+void StopAudio();
+
+// Appends one JSON object per line to a file every interval (UWU_TELEMETRY
+// names the file, UWU_TELEMETRY_MS the period) so glitches can be lined up
+// with callback timing after the fact. Counters are cumulative since start.
+class TelemetryDump {
+public:
+    TelemetryDump(PlaybackEngine& engine, const std::string& path, int interval_ms);
+
+    ~TelemetryDump();
+
+    TelemetryDump(const TelemetryDump&) = delete;
+    TelemetryDump& operator=(const TelemetryDump&) = delete;
+
+    bool ok() const { return file != nullptr; }
+
+private:
+    void run();
+
+    void write_line(const AudioTelemetry::Snapshot& s);
+
+    PlaybackEngine& engine;
+    std::chrono::milliseconds interval;
+    FILE* file = nullptr;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+};
@@ -0,0 +1,55 @@
+#include "events.h"
+
+#include <sys/ioctl.h>
+#include <ncurses.h>
+
+EventLoop g_events;
+
+unsigned EventLoop::wait(int timeout_ms) {
+    if (control_idle) control_idle();
+
+    struct epoll_event events[8];
+    int n = epoll_wait(epoll_fd, events, 8, timeout_ms);
+
+    unsigned fired = 0;
+    for (int i = 0; i < n; ++i) {
+        unsigned tag = events[i].data.u32;
+        fired |= tag;
+        uint64_t count;
+        switch (tag) {
+            case Tick:
+                if (read(timer_fd, &count, sizeof(count)) < 0) {}
+                break;
+            case Engine:
+                if (read(engine_fd, &count, sizeof(count)) < 0) {}
+                break;
+            case Wake:
+                if (read(wake_fd, &count, sizeof(count)) < 0) {}
+                break;
+            case Control:
+                if (control_ready) control_ready();
+                break;
+            case Resize: {
+                struct signalfd_siginfo info;
+                bool resized = false;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    if (info.ssi_signo == SIGWINCH) {
+                        resized = true;
+                    } else {
+                        fired |= Quit;
+                    }
+                }
+                if (!resized) {
+                    fired &= ~Resize;
+                    break;
+                }
+                struct winsize ws;
+                if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0) {
+                    resize_term(ws.ws_row, ws.ws_col);
+                }
+                break;
+            }
+        }
+    }
+    return fired;
+}
@@ -0,0 +1,119 @@
+#pragma once
+// The UI thread's event loop, shared with workers that need to wake it
+
+#include "common.h"
+#include <sys/epoll.h> // for the UI event loop
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+
+// --- Event Loop ---
+
+// Progress/clock refresh interval while something on screen is moving
+const int PROGRESS_TICK_MS = 250;
+
+// Single epoll set for the UI thread: key presses on stdin, a timerfd for
+// progress ticks, the engine's eventfd (track end/change, buffering), a
+// wake eventfd for background workers, the control socket and SIGWINCH
+// through a signalfd. The UI thread sleeps in wait() until one of them
+// fires, so an idle player costs no wakeups at all.
+class EventLoop {
+public:
+    enum : unsigned { Input = 1, Tick = 2, Engine = 4, Resize = 8, Wake = 16, Control = 32, Quit = 64 };
+
+    ~EventLoop() {
+        for (int fd : {timer_fd, signal_fd, wake_fd, epoll_fd}) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    // Must run before any thread is started so that the signals stay
+    // blocked in every thread and are only ever seen through the signalfd.
+    // Without a terminal (headless) stdin is left alone and SIGINT, SIGTERM
+    // and SIGHUP are reported as Quit instead of SIGWINCH as Resize.
+    bool init(bool interactive = true) {
+        sigset_t mask;
+        sigemptyset(&mask);
+        if (interactive) {
+            sigaddset(&mask, SIGWINCH);
+        } else {
+            sigaddset(&mask, SIGINT);
+            sigaddset(&mask, SIGTERM);
+            sigaddset(&mask, SIGHUP);
+        }
+        pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0 || timer_fd < 0 || signal_fd < 0 || wake_fd < 0) {
+            return false;
+        }
+
+        if (interactive) add(STDIN_FILENO, Input);
+        add(timer_fd, Tick);
+        add(signal_fd, Resize);
+        add(wake_fd, Wake);
+        return true;
+    }
+
+    void watch_engine(int fd) {
+        if (fd >= 0) add(fd, Engine);
+        engine_fd = fd;
+    }
+
+    // The control socket is served inside wait() itself, so commands are
+    // answered on every screen: on_ready runs when fd has activity and
+    // before_sleep each time wait() is entered
+    void watch_control(int fd, std::function<void()> on_ready, std::function<void()> before_sleep) {
+        if (fd < 0) return;
+        add(fd, Control);
+        control_ready = std::move(on_ready);
+        control_idle = std::move(before_sleep);
+    }
+
+    // Periodic tick every interval_ms; 0 disarms it
+    void set_tick(int interval_ms) {
+        if (interval_ms == tick_ms || timer_fd < 0) return;
+        tick_ms = interval_ms;
+
+        struct itimerspec spec = {};
+        spec.it_interval.tv_sec = interval_ms / 1000;
+        spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+        spec.it_value = spec.it_interval;
+        timerfd_settime(timer_fd, 0, &spec, nullptr);
+    }
+
+    // Block until at least one source fires (or timeout_ms elapses) and
+    // return the mask of sources that did. Resizes are applied to curses
+    // here, before the caller redraws.
+    unsigned wait(int timeout_ms = -1);
+
+    // Wake the UI thread from any thread
+    void wake() {
+        uint64_t one = 1;
+        if (wake_fd >= 0 && write(wake_fd, &one, sizeof(one)) < 0) {}
+    }
+
+private:
+    void add(int fd, unsigned tag) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u32 = tag;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    int epoll_fd = -1;
+    int timer_fd = -1;
+    int signal_fd = -1;
+    int wake_fd = -1;
+    int engine_fd = -1;
+    int tick_ms = 0;
+    std::function<void()> control_ready;
+    std::function<void()> control_idle;
+};
+
+// Global UI event loop
+extern EventLoop g_events;
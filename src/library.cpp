@@ -0,0 +1,1080 @@
+#include "library.h"
+
+#include <sys/mman.h> // for the library index
+
+#if defined(__SSE2__)
+#include <immintrin.h> // for the art scaler
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// For the list of formats libsndfile can open
+#include <sndfile.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// For MP3 Metadata and Tagging (using TagLib)
+#include <taglib/fileref.h>
+#include <taglib/tag.h>
+#include <taglib/mpegfile.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/id3v2frame.h>
+#include <taglib/attachedpictureframe.h>
+
+// --- Album Art ---
+
+// Brightness ramp for the ASCII form, darkest first
+const std::string ASCII_CHARS = " .:-=+*#%@";
+
+// Covers larger than this are not worth decoding for a 40x40 thumbnail
+const int64_t MAX_COVER_PIXELS = 64LL * 1024 * 1024;
+
+// Convert brightness to ASCII character
+char brightnessToASCII(int brightness) {
+    int index = (brightness * (ASCII_CHARS.length() - 1)) / 255;
+    return ASCII_CHARS[index];
+}
+
+// Nearest colour of the xterm 6x6x6 cube or grey ramp (indices 16-255)
+uint8_t xterm256(int r, int g, int b) {
+    static const int steps[6] = {0, 95, 135, 175, 215, 255};
+    auto level = [](int v) { return v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40; };
+    int ri = level(r), gi = level(g), bi = level(b);
+    auto dist = [&](int cr, int cg, int cb) {
+        return (r - cr) * (r - cr) + (g - cg) * (g - cg) + (b - cb) * (b - cb);
+    };
+
+    int grey = std::min(23, std::max(0, ((r + g + b) / 3 - 3) / 10));
+    int grey_value = 8 + grey * 10;
+    if (dist(grey_value, grey_value, grey_value) < dist(steps[ri], steps[gi], steps[bi])) {
+        return static_cast<uint8_t>(232 + grey);
+    }
+    return static_cast<uint8_t>(16 + 36 * ri + 6 * gi + bi);
+}
+
+bool decodeCoverImage(const char* data, size_t size, int& width, int& height, std::vector<uint8_t>& rgb) {
+    AVCodecID id;
+    if (size >= 3 && memcmp(data, "\xFF\xD8\xFF", 3) == 0) {
+        id = AV_CODEC_ID_MJPEG;
+    } else if (size >= 8 && memcmp(data, "\x89PNG\r\n\x1A\n", 8) == 0) {
+        id = AV_CODEC_ID_PNG;
+    } else {
+        return false;
+    }
+
+    const AVCodec* decoder = avcodec_find_decoder(id);
+    if (!decoder) return false;
+    AVCodecContext* codec = avcodec_alloc_context3(decoder);
+    AVPacket* packet = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+
+    // Decoders may read a little past the end of the packet
+    std::vector<uint8_t> padded(size + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+    memcpy(padded.data(), data, size);
+
+    bool ok = false;
+    if (codec && packet && frame && avcodec_open2(codec, decoder, nullptr) >= 0) {
+        packet->data = padded.data();
+        packet->size = static_cast<int>(size);
+        if (avcodec_send_packet(codec, packet) >= 0) {
+            int ret = avcodec_receive_frame(codec, frame);
+            if (ret == AVERROR(EAGAIN)) {
+                avcodec_send_packet(codec, nullptr);
+                ret = avcodec_receive_frame(codec, frame);
+            }
+            ok = (ret == 0 && frame->width > 0 && frame->height > 0 &&
+                  static_cast<int64_t>(frame->width) * frame->height <= MAX_COVER_PIXELS);
+        }
+        packet->data = nullptr;
+        packet->size = 0;
+    }
+
+    // Pixel format conversion only; scaling is downscaleArea's job
+    if (ok) {
+        width = frame->width;
+        height = frame->height;
+        SwsContext* sws = sws_getContext(width, height, static_cast<AVPixelFormat>(frame->format),
+                                         width, height, AV_PIX_FMT_RGB24, SWS_POINT,
+                                         nullptr, nullptr, nullptr);
+        if (sws) {
+            rgb.assign(static_cast<size_t>(width) * height * 3, 0);
+            uint8_t* dst[1] = {rgb.data()};
+            int dst_stride[1] = {width * 3};
+            ok = sws_scale(sws, frame->data, frame->linesize, 0, height, dst, dst_stride) == height;
+            sws_freeContext(sws);
+        } else {
+            ok = false;
+        }
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    avcodec_free_context(&codec);
+    return ok;
+}
+
+// acc[i] += src[i] over count bytes: the vertical half of the box filter,
+// and where nearly all of the time goes on a large cover
+inline void accumulateRow(uint32_t* acc, const uint8_t* src, size_t count) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+        _mm_storeu_si128(a + 0, _mm_add_epi32(_mm_loadu_si128(a + 0), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t bytes = vld1q_u8(src + i);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+        vst1q_u32(acc + i, vaddw_u16(vld1q_u32(acc + i), vget_low_u16(lo)));
+        vst1q_u32(acc + i + 4, vaddw_u16(vld1q_u32(acc + i + 4), vget_high_u16(lo)));
+        vst1q_u32(acc + i + 8, vaddw_u16(vld1q_u32(acc + i + 8), vget_low_u16(hi)));
+        vst1q_u32(acc + i + 12, vaddw_u16(vld1q_u32(acc + i + 12), vget_high_u16(hi)));
+    }
+#endif
+    for (; i < count; ++i) {
+        acc[i] += src[i];
+    }
+}
+
+// Area-average a packed RGB24 image onto a dst_w x dst_h grid: every
+// source pixel lands in exactly one output pixel, so nothing is skipped
+// and nothing aliases. Upscaling repeats pixels.
+void downscaleArea(const uint8_t* src, int src_w, int src_h, uint8_t* dst, int dst_w, int dst_h) {
+    std::vector<uint32_t> acc(static_cast<size_t>(src_w) * 3);
+    for (int y = 0; y < dst_h; ++y) {
+        int y0 = static_cast<int>(static_cast<int64_t>(y) * src_h / dst_h);
+        int y1 = std::max(y0 + 1, static_cast<int>(static_cast<int64_t>(y + 1) * src_h / dst_h));
+
+        std::fill(acc.begin(), acc.end(), 0);
+        for (int sy = y0; sy < y1; ++sy) {
+            accumulateRow(acc.data(), src + static_cast<size_t>(sy) * src_w * 3, acc.size());
+        }
+
+        for (int x = 0; x < dst_w; ++x) {
+            int x0 = static_cast<int>(static_cast<int64_t>(x) * src_w / dst_w);
+            int x1 = std::max(x0 + 1, static_cast<int>(static_cast<int64_t>(x + 1) * src_w / dst_w));
+            uint32_t sum[3] = {0, 0, 0};
+            for (int sx = x0; sx < x1; ++sx) {
+                sum[0] += acc[sx * 3];
+                sum[1] += acc[sx * 3 + 1];
+                sum[2] += acc[sx * 3 + 2];
+            }
+            uint32_t area = static_cast<uint32_t>((x1 - x0) * (y1 - y0));
+            uint8_t* out = dst + (static_cast<size_t>(y) * dst_w + x) * 3;
+            for (int c = 0; c < 3; ++c) {
+                out[c] = static_cast<uint8_t>((sum[c] + area / 2) / area);
+            }
+        }
+    }
+}
+
+std::shared_ptr<const AlbumArt> placeholderArt() {
+    static const std::shared_ptr<const AlbumArt> placeholder = [] {
+        // Generate a clean musical themed pattern using simple ASCII
+        std::vector<std::string> musicPattern = {
+            "+--------------------------------------+",
+            "|            ALBUM ARTWORK             |",
+            "|               ~ * ~                  |",
+            "|          +-------------+             |",
+            "|          |  *       ~  |             |",
+            "|          |             |             |",
+            "|          |    ~   *    |             |",
+            "|          |             |             |",
+            "|          |  *       ~  |             |",
+            "|          +-------------+             |",
+            "|                                      |",
+            "|         ##############               |",
+            "|         ##          ##               |",
+            "|         ##    *~    ##               |",
+            "|         ##          ##               |",
+            "|         ##############               |",
+            "|                                      |",
+            "|            NO IMAGE FOUND            |",
+            "+--------------------------------------+",
+            "                                        "
+        };
+
+        auto art = std::make_shared<AlbumArt>();
+        art->ascii.assign(THUMBNAIL_HEIGHT, std::string(THUMBNAIL_WIDTH, ' '));
+        for (int i = 0; i < THUMBNAIL_HEIGHT && i < static_cast<int>(musicPattern.size()); i++) {
+            art->ascii[i] = musicPattern[i].substr(0, THUMBNAIL_WIDTH);
+            art->ascii[i].resize(THUMBNAIL_WIDTH, ' ');
+        }
+        return art;
+    }();
+    return placeholder;
+}
+
+std::shared_ptr<const AlbumArt> renderAlbumArt(const std::vector<uint8_t>& rgb, int width, int height) {
+    int fit_w = ART_PIXEL_WIDTH;
+    int fit_h = static_cast<int>(static_cast<int64_t>(height) * ART_PIXEL_WIDTH / width);
+    if (fit_h > ART_PIXEL_HEIGHT) {
+        fit_h = ART_PIXEL_HEIGHT;
+        fit_w = static_cast<int>(static_cast<int64_t>(width) * ART_PIXEL_HEIGHT / height);
+    }
+    fit_w = std::max(1, fit_w);
+    fit_h = std::max(1, fit_h);
+
+    std::vector<uint8_t> scaled(static_cast<size_t>(fit_w) * fit_h * 3);
+    downscaleArea(rgb.data(), width, height, scaled.data(), fit_w, fit_h);
+
+    std::vector<uint8_t> panel(static_cast<size_t>(ART_PIXEL_WIDTH) * ART_PIXEL_HEIGHT * 3, 0);
+    int left = (ART_PIXEL_WIDTH - fit_w) / 2;
+    int top = (ART_PIXEL_HEIGHT - fit_h) / 2;
+    for (int y = 0; y < fit_h; ++y) {
+        memcpy(panel.data() + ((static_cast<size_t>(top + y) * ART_PIXEL_WIDTH) + left) * 3,
+               scaled.data() + static_cast<size_t>(y) * fit_w * 3, static_cast<size_t>(fit_w) * 3);
+    }
+
+    auto art = std::make_shared<AlbumArt>();
+    art->cells.resize(static_cast<size_t>(ART_PIXEL_WIDTH) * ART_PIXEL_HEIGHT);
+    for (size_t i = 0; i < art->cells.size(); ++i) {
+        art->cells[i] = xterm256(panel[i * 3], panel[i * 3 + 1], panel[i * 3 + 2]);
+    }
+
+    // Each character covers two pixels; weight by perceived luminance
+    art->ascii.assign(THUMBNAIL_HEIGHT, std::string(THUMBNAIL_WIDTH, ' '));
+    for (int y = 0; y < THUMBNAIL_HEIGHT; ++y) {
+        for (int x = 0; x < THUMBNAIL_WIDTH; ++x) {
+            int luma = 0;
+            for (int half = 0; half < 2; ++half) {
+                const uint8_t* p = panel.data() + ((static_cast<size_t>(y * 2 + half) * ART_PIXEL_WIDTH) + x) * 3;
+                luma += (p[0] * 299 + p[1] * 587 + p[2] * 114) / 1000;
+            }
+            art->ascii[y][x] = brightnessToASCII(luma / 2);
+        }
+    }
+    return art;
+}
+
+std::shared_ptr<const AlbumArt> albumArtFor(const char* data, size_t size) {
+    static std::mutex mutex;
+    static std::unordered_map<size_t, std::weak_ptr<const AlbumArt>> rendered;
+
+    size_t key = std::hash<std::string_view>{}(std::string_view(data, size)) ^ size;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = rendered.find(key);
+        if (it != rendered.end()) {
+            if (auto art = it->second.lock()) return art;
+        }
+    }
+
+    int width = 0, height = 0;
+    std::vector<uint8_t> rgb;
+    if (!decodeCoverImage(data, size, width, height, rgb)) return placeholderArt();
+    std::shared_ptr<const AlbumArt> art = renderAlbumArt(rgb, width, height);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (rendered.size() > 256) {
+        for (auto it = rendered.begin(); it != rendered.end();) {
+            it = it->second.expired() ? rendered.erase(it) : std::next(it);
+        }
+    }
+    rendered[key] = art;
+    return art;
+}
+
+std::shared_ptr<const AlbumArt> extractAlbumArt(const std::string& filePath) {
+    TagLib::MPEG::File file(filePath.c_str());
+    
+    if (!file.isValid()) {
+        return placeholderArt();
+    }
+    
+    TagLib::ID3v2::Tag* id3v2Tag = file.ID3v2Tag();
+    if (!id3v2Tag) {
+        return placeholderArt();
+    }
+    
+    TagLib::ID3v2::FrameList frameList = id3v2Tag->frameList("APIC");
+    if (frameList.isEmpty()) {
+        return placeholderArt();
+    }
+    
+    TagLib::ID3v2::AttachedPictureFrame* pictureFrame = 
+        static_cast<TagLib::ID3v2::AttachedPictureFrame*>(frameList.front());
+    
+    if (!pictureFrame) {
+        return placeholderArt();
+    }
+    
+    TagLib::ByteVector imageData = pictureFrame->picture();
+    if (imageData.isEmpty()) {
+        return placeholderArt();
+    }
+    return albumArtFor(imageData.data(), imageData.size());
+}
+
+std::shared_ptr<TrackMeta> loadTrackMeta(const std::string& path) {
+    auto meta = std::make_shared<TrackMeta>();
+
+    TagLib::FileRef f(path.c_str());
+    if (!f.isNull() && f.tag()) {
+        TagLib::Tag *tag = f.tag();
+        meta->title = tag->title().toCString(true);
+        meta->artist = tag->artist().toCString(true);
+        meta->album = tag->album().toCString(true);
+    }
+    if (!f.isNull() && f.audioProperties()) {
+        meta->duration_seconds = f.audioProperties()->lengthInSeconds();
+    }
+    meta->art = extractAlbumArt(path);
+    meta->art_loaded = true;
+    return meta;
+}
+
+MetadataCache::~MetadataCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+std::shared_ptr<const TrackMeta> MetadataCache::lookup(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Node& node = *entries.try_emplace(path).first;
+    Entry& entry = node.second;
+    auto now = std::chrono::steady_clock::now();
+    if (!entry.pending &&
+        (!entry.meta || !entry.meta->art_loaded || now - entry.checked > REVALIDATE_AFTER)) {
+        enqueue_locked(node);
+    }
+    return entry.meta;
+}
+
+void MetadataCache::prefetch(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Node& node = *entries.try_emplace(path).first;
+    Entry& entry = node.second;
+    if ((!entry.meta || !entry.meta->art_loaded) && !entry.pending) {
+        enqueue_locked(node);
+    }
+}
+
+void MetadataCache::seed(const std::string& path, TrackMeta meta) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[path];
+    if (!entry.meta) {
+        entry.meta = std::make_shared<const TrackMeta>(std::move(meta));
+        entry.checked = std::chrono::steady_clock::now();
+    }
+}
+
+void MetadataCache::enqueue_locked(Node& node) {
+    node.second.pending = true;
+    if (queued == MAX_QUEUE) {
+        queue[(queue_front + MAX_QUEUE - 1) % MAX_QUEUE]->second.pending = false;
+        queued--;
+    }
+    queue_front = (queue_front + MAX_QUEUE - 1) % MAX_QUEUE;
+    queue[queue_front] = &node;
+    queued++;
+    cv.notify_one();
+}
+
+void MetadataCache::worker_loop() {
+    while (true) {
+        Node* node;
+        std::shared_ptr<const TrackMeta> current;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping) return;
+            node = queue[queue_front];
+            queue_front = (queue_front + 1) % MAX_QUEUE;
+            queued--;
+            current = node->second.meta;
+        }
+        const std::string& path = node->first;
+
+        struct stat st;
+        bool stat_ok = (stat(path.c_str(), &st) == 0);
+        int64_t mtime = stat_ok ? stat_mtime_ns(st) : 0;
+
+        std::shared_ptr<const TrackMeta> fresh = current;
+        if (!current || !stat_ok || current->mtime != mtime) {
+            auto meta = loadTrackMeta(path);
+            meta->mtime = mtime;
+            fresh = meta;
+        } else if (!current->art_loaded) {
+            // Tags came from the index; only the cover is missing
+            auto meta = std::make_shared<TrackMeta>(*current);
+            meta->art = extractAlbumArt(path);
+            meta->art_loaded = true;
+            fresh = meta;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Entry& entry = node->second;
+            entry.meta = fresh;
+            entry.checked = std::chrono::steady_clock::now();
+            entry.pending = false;
+        }
+        if (fresh != current && on_update) on_update();
+    }
+}
+
+// --- Library Index ---
+
+const std::unordered_set<std::string>& supported_audio_extensions() {
+    static const std::unordered_set<std::string> extensions = [] {
+        std::unordered_set<std::string> exts = {".mp3", ".flac", ".ogg", ".oga", ".opus", ".wav", ".aif", ".aiff"};
+        int count = 0;
+        sf_command(nullptr, SFC_GET_FORMAT_MAJOR_COUNT, &count, sizeof(int));
+        for (int i = 0; i < count; ++i) {
+            SF_FORMAT_INFO info = {};
+            info.format = i;
+            if (sf_command(nullptr, SFC_GET_FORMAT_MAJOR, &info, sizeof(info)) == 0 && info.extension) {
+                exts.insert(std::string(".") + info.extension);
+            }
+        }
+        return exts;
+    }();
+    return extensions;
+}
+
+bool is_audio_file(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return supported_audio_extensions().count(ext) != 0;
+}
+
+thread_local WorkStealingPool* WorkStealingPool::current_pool = nullptr;
+thread_local unsigned WorkStealingPool::current_worker = 0;
+
+WorkStealingPool::WorkStealingPool(unsigned thread_count) {
+    thread_count = std::max(1u, thread_count);
+    for (unsigned i = 0; i < thread_count; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < thread_count; ++i) {
+        threads.emplace_back(&WorkStealingPool::worker_loop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        stopping = true;
+    }
+    idle_cv.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+    outstanding++;
+    unsigned target = (current_pool == this)
+        ? current_worker
+        : next_queue++ % static_cast<unsigned>(queues.size());
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mutex);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        queued++;
+    }
+    idle_cv.notify_one();
+}
+
+void WorkStealingPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(idle_mutex);
+    done_cv.wait(lock, [this] { return outstanding.load() == 0; });
+}
+
+bool WorkStealingPool::try_take(unsigned self, std::function<void()>& task) {
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        Queue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::worker_loop(unsigned self) {
+    current_pool = this;
+    current_worker = self;
+
+    while (true) {
+        std::function<void()> task;
+        if (!try_take(self, task)) {
+            std::unique_lock<std::mutex> lock(idle_mutex);
+            idle_cv.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping) return;
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            queued--;
+        }
+
+        task();
+
+        if (--outstanding == 0) {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            done_cv.notify_all();
+        }
+    }
+}
+
+unsigned scan_thread_count() {
+    if (const char* env = getenv("UWU_SCAN_THREADS")) {
+        return std::max(1, atoi(env));
+    }
+    return std::max(4u, std::thread::hardware_concurrency());
+}
+
+LibraryTrack readLibraryTrack(const std::string& path, const struct stat& st) {
+    LibraryTrack track;
+    track.path = path;
+    track.size = static_cast<uint64_t>(st.st_size);
+    track.mtime = stat_mtime_ns(st);
+
+    TagLib::FileRef f(path.c_str());
+    if (!f.isNull() && f.tag()) {
+        track.title = f.tag()->title().toCString(true);
+        track.artist = f.tag()->artist().toCString(true);
+        track.album = f.tag()->album().toCString(true);
+    }
+    if (!f.isNull() && f.audioProperties()) {
+        track.duration_ms = f.audioProperties()->lengthInMilliseconds();
+    }
+    return track;
+}
+
+LibraryIndex::LibraryIndex(const std::string& root, const std::string& cache_dir)
+    : root(fs::absolute(root).lexically_normal().string()) {
+    while (this->root.size() > 1 && this->root.back() == '/') {
+        this->root.pop_back();
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "library-%016llx.idx",
+             static_cast<unsigned long long>(fnv1a_64(this->root)));
+    index_path = cache_dir + "/" + name;
+}
+
+LibraryIndex::~LibraryIndex() {
+    cancelled = true;
+    if (scan_thread.joinable()) {
+        scan_thread.join();
+    }
+    unmap();
+}
+
+size_t LibraryIndex::open() {
+    map();
+
+    dir_fresh.assign(dir_count(), false);
+    stale_dirs.clear();
+    if (dir_count() == 0) {
+        stale_dirs.push_back({root, nullptr});
+    }
+    for (size_t d = 0; d < dir_count(); ++d) {
+        const LibraryDirRecord& rec = dir_records()[d];
+        std::string path(str(rec.path));
+
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            any_removed = true; // directory vanished
+            continue;
+        }
+        if (stat_mtime_ns(st) != rec.mtime) {
+            stale_dirs.push_back({path, &rec});
+        } else {
+            dir_fresh[d] = true;
+        }
+    }
+    return stale_dirs.size();
+}
+
+void LibraryIndex::start_rescan() {
+    if (stale_dirs.empty() && !any_removed) {
+        scan_done = true;
+        return;
+    }
+    scan_started = std::chrono::steady_clock::now();
+    scan_thread = std::thread(&LibraryIndex::rescan, this);
+}
+
+void LibraryIndex::take_discovered(std::vector<LibraryTrack>& out) {
+    std::lock_guard<std::mutex> lock(discovered_mutex);
+    for (auto& track : discovered) out.push_back(std::move(track));
+    discovered.clear();
+}
+
+double LibraryIndex::files_per_second() const {
+    auto end = scan_done ? scan_finished.load() : std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(end - scan_started).count();
+    return secs > 0 ? files_seen.load() / secs : 0.0;
+}
+
+const LibraryDirRecord* LibraryIndex::dir_records() const {
+    return reinterpret_cast<const LibraryDirRecord*>(header + 1);
+}
+
+const LibraryTrackRecord* LibraryIndex::track_records() const {
+    return reinterpret_cast<const LibraryTrackRecord*>(dir_records() + header->dir_count);
+}
+
+std::string_view LibraryIndex::str(const LibraryString& s) const {
+    const char* pool = reinterpret_cast<const char*>(track_records() + header->track_count);
+    return std::string_view(pool + s.offset, s.length);
+}
+
+void LibraryIndex::map() {
+    unmap();
+    int fd = ::open(index_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(LibraryIndexHeader)) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            mapped = addr;
+            mapped_size = st.st_size;
+            madvise(mapped, mapped_size, MADV_WILLNEED);
+        }
+    }
+    close(fd);
+
+    if (mapped) attach(static_cast<const char*>(mapped), mapped_size);
+}
+
+void LibraryIndex::unmap() {
+    header = nullptr;
+    if (mapped) {
+        munmap(mapped, mapped_size);
+        mapped = nullptr;
+        mapped_size = 0;
+    }
+    image.clear();
+}
+
+void LibraryIndex::attach(const char* data, size_t len) {
+    const LibraryIndexHeader* h = reinterpret_cast<const LibraryIndexHeader*>(data);
+    if (memcmp(h->magic, LIBRARY_INDEX_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != LIBRARY_INDEX_VERSION) {
+        return;
+    }
+    uint64_t expected = sizeof(LibraryIndexHeader) +
+                        uint64_t(h->dir_count) * sizeof(LibraryDirRecord) +
+                        uint64_t(h->track_count) * sizeof(LibraryTrackRecord) +
+                        h->pool_size;
+    if (expected != len) return;
+    header = h;
+}
+
+LibraryTrack LibraryIndex::owned_track(const LibraryTrackRecord& t) const {
+    LibraryTrack track;
+    track.path = std::string(str(t.path));
+    track.title = std::string(str(t.title));
+    track.artist = std::string(str(t.artist));
+    track.album = std::string(str(t.album));
+    track.size = t.size;
+    track.mtime = t.mtime;
+    track.duration_ms = t.duration_ms;
+    return track;
+}
+
+LibraryDir LibraryIndex::load_dir(const LibraryDirRecord& rec) const {
+    LibraryDir dir;
+    dir.path = std::string(str(rec.path));
+    dir.mtime = rec.mtime;
+    dir.tracks.reserve(rec.track_count);
+    for (uint32_t i = rec.first_track; i < rec.first_track + rec.track_count; ++i) {
+        dir.tracks.push_back(owned_track(track_records()[i]));
+    }
+    return dir;
+}
+
+void LibraryIndex::rescan() {
+    known_dirs.clear();
+    for (size_t d = 0; d < dir_count(); ++d) {
+        known_dirs.insert(std::string(str(dir_records()[d].path)));
+    }
+
+    {
+        WorkStealingPool pool(scan_thread_count());
+        for (const StaleDir& stale : stale_dirs) {
+            pool.submit([this, &pool, stale] { scan_dir(pool, stale.path, stale.previous); });
+        }
+        pool.wait_idle();
+    }
+
+    scan_finished = std::chrono::steady_clock::now();
+    if (!cancelled) {
+        std::vector<LibraryDir> dirs;
+        for (size_t d = 0; d < dir_count(); ++d) {
+            if (dir_fresh[d]) dirs.push_back(load_dir(dir_records()[d]));
+        }
+        for (auto& entry : scanned) {
+            dirs.push_back(std::move(entry.second));
+        }
+        rebuild(dirs);
+    }
+    scan_done = true;
+}
+
+void LibraryIndex::publish(const std::string& dir_path, LibraryTrack track) {
+    files_seen++;
+    {
+        std::lock_guard<std::mutex> lock(scanned_mutex);
+        scanned[dir_path].tracks.push_back(track);
+    }
+    std::lock_guard<std::mutex> lock(discovered_mutex);
+    discovered.push_back(std::move(track));
+}
+
+void LibraryIndex::scan_dir(WorkStealingPool& pool, const std::string& path, const LibraryDirRecord* previous) {
+    if (cancelled) return;
+
+    std::unordered_map<std::string_view, const LibraryTrackRecord*> known;
+    if (previous) {
+        for (uint32_t i = previous->first_track; i < previous->first_track + previous->track_count; ++i) {
+            known[str(track_records()[i].path)] = &track_records()[i];
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(scanned_mutex);
+        LibraryDir& dir = scanned[path];
+        dir.path = path;
+        struct stat dst;
+        if (stat(path.c_str(), &dst) == 0) {
+            dir.mtime = stat_mtime_ns(dst);
+        }
+    }
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(path, ec)) {
+        if (cancelled) return;
+
+        std::error_code type_ec;
+        if (entry.is_directory(type_ec) && !entry.is_symlink(type_ec)) {
+            std::string sub = entry.path().string();
+            if (!known_dirs.count(sub)) {
+                pool.submit([this, &pool, sub] { scan_dir(pool, sub, nullptr); });
+            }
+            continue;
+        }
+        if (!is_audio_file(entry.path())) continue;
+
+        std::string file = entry.path().string();
+        struct stat st;
+        if (stat(file.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        auto it = known.find(file);
+        if (it != known.end() && it->second->size == static_cast<uint64_t>(st.st_size) &&
+            it->second->mtime == stat_mtime_ns(st)) {
+            publish(path, owned_track(*it->second));
+        } else {
+            pool.submit([this, path, file, st] {
+                if (!cancelled) publish(path, readLibraryTrack(file, st));
+            });
+        }
+    }
+}
+
+void LibraryIndex::rebuild(std::vector<LibraryDir>& dirs) {
+    std::sort(dirs.begin(), dirs.end(),
+              [](const LibraryDir& a, const LibraryDir& b) { return a.path < b.path; });
+    for (LibraryDir& dir : dirs) {
+        std::sort(dir.tracks.begin(), dir.tracks.end(),
+                  [](const LibraryTrack& a, const LibraryTrack& b) { return a.path < b.path; });
+    }
+
+    std::vector<LibraryDirRecord> dir_recs;
+    std::vector<LibraryTrackRecord> track_recs;
+    std::string pool;
+
+    auto intern = [&pool](const std::string& s) {
+        LibraryString ref = {static_cast<uint32_t>(pool.size()), static_cast<uint32_t>(s.size())};
+        pool += s;
+        return ref;
+    };
+
+    for (const LibraryDir& dir : dirs) {
+        LibraryDirRecord rec = {};
+        rec.path = intern(dir.path);
+        rec.mtime = dir.mtime;
+        rec.first_track = static_cast<uint32_t>(track_recs.size());
+        rec.track_count = static_cast<uint32_t>(dir.tracks.size());
+        for (const LibraryTrack& track : dir.tracks) {
+            LibraryTrackRecord t = {};
+            t.path = intern(track.path);
+            t.title = intern(track.title);
+            t.artist = intern(track.artist);
+            t.album = intern(track.album);
+            t.size = track.size;
+            t.mtime = track.mtime;
+            t.duration_ms = track.duration_ms;
+            t.dir_index = static_cast<uint32_t>(dir_recs.size());
+            track_recs.push_back(t);
+        }
+        dir_recs.push_back(rec);
+    }
+
+    LibraryIndexHeader h = {};
+    memcpy(h.magic, LIBRARY_INDEX_MAGIC, sizeof(h.magic));
+    h.version = LIBRARY_INDEX_VERSION;
+    h.dir_count = static_cast<uint32_t>(dir_recs.size());
+    h.track_count = static_cast<uint32_t>(track_recs.size());
+    h.pool_size = pool.size();
+
+    std::vector<char> out;
+    out.reserve(sizeof(h) + dir_recs.size() * sizeof(LibraryDirRecord) +
+                track_recs.size() * sizeof(LibraryTrackRecord) + pool.size());
+    auto append = [&out](const void* p, size_t n) {
+        out.insert(out.end(), static_cast<const char*>(p), static_cast<const char*>(p) + n);
+    };
+    append(&h, sizeof(h));
+    append(dir_recs.data(), dir_recs.size() * sizeof(LibraryDirRecord));
+    append(track_recs.data(), track_recs.size() * sizeof(LibraryTrackRecord));
+    append(pool.data(), pool.size());
+
+    std::string tmp = index_path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    bool written = f && fwrite(out.data(), 1, out.size(), f) == out.size();
+    if (f) written = (fclose(f) == 0) && written;
+    if (written && rename(tmp.c_str(), index_path.c_str()) == 0) {
+        map();
+        if (header) return;
+    } else {
+        unlink(tmp.c_str());
+    }
+
+    unmap();
+    image = std::move(out);
+    attach(image.data(), image.size());
+}
+
+// --- Library Search ---
+
+static void fold_into(std::string& out, std::string_view text) {
+    for (char c : text) out += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static uint32_t trigram_at(std::string_view s, size_t i) {
+    return uint32_t(uint8_t(s[i])) << 16 | uint32_t(uint8_t(s[i + 1])) << 8 | uint8_t(s[i + 2]);
+}
+
+std::string_view LibrarySearch::key(uint32_t id) const {
+    return std::string_view(pool).substr(key_offsets[id], key_offsets[id + 1] - key_offsets[id]);
+}
+
+LibrarySearch::LibrarySearch(std::function<void()> on_results) : on_results(std::move(on_results)) {
+    worker = std::thread(&LibrarySearch::run, this);
+}
+
+LibrarySearch::~LibrarySearch() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void LibrarySearch::add(std::string_view title, std::string_view artist, std::string_view album,
+                        std::string_view path) {
+    size_t slash = path.rfind('/');
+    std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+
+    // Fields are joined by newlines, which no query term can contain
+    std::string doc;
+    doc.reserve(title.size() + artist.size() + album.size() + name.size() + 3);
+    fold_into(doc, title);
+    doc += '\n';
+    fold_into(doc, artist);
+    doc += '\n';
+    fold_into(doc, album);
+    doc += '\n';
+    fold_into(doc, name);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending_docs.push_back(std::move(doc));
+    }
+    wake.notify_one();
+}
+
+void LibrarySearch::submit(std::string query) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending_query = std::move(query);
+        query_waiting = true;
+        generation++;
+    }
+    wake.notify_one();
+}
+
+bool LibrarySearch::take_results(std::vector<uint32_t>& ids, std::string& query) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!results_ready) return false;
+    ids.swap(results);
+    query = results_query;
+    results_ready = false;
+    return true;
+}
+
+void LibrarySearch::ingest(std::vector<std::string>& docs) {
+    std::vector<uint32_t> grams;
+    for (const std::string& doc : docs) {
+        uint32_t id = static_cast<uint32_t>(key_offsets.size() - 1);
+        pool += doc;
+        key_offsets.push_back(static_cast<uint32_t>(pool.size()));
+
+        grams.clear();
+        for (size_t i = 0; i + 3 <= doc.size(); ++i) grams.push_back(trigram_at(doc, i));
+        std::sort(grams.begin(), grams.end());
+        grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+        for (uint32_t gram : grams) postings[gram].push_back(id);
+    }
+}
+
+bool LibrarySearch::match(const std::string& query, uint64_t query_generation, std::vector<uint32_t>& out) {
+    std::vector<std::string> terms;
+    std::string folded;
+    fold_into(folded, query);
+    std::istringstream words(folded);
+    for (std::string term; words >> term;) terms.push_back(std::move(term));
+
+    uint32_t count = static_cast<uint32_t>(key_offsets.size() - 1);
+    out.clear();
+
+    // Candidates come from the rarest trigram of any term. A term with a
+    // trigram nobody has rules everything out.
+    const std::vector<uint32_t>* rarest = nullptr;
+    bool none = false;
+    for (const std::string& term : terms) {
+        for (size_t i = 0; i + 3 <= term.size(); ++i) {
+            auto it = postings.find(trigram_at(term, i));
+            if (it == postings.end()) {
+                none = true;
+                break;
+            }
+            if (!rarest || it->second.size() < rarest->size()) rarest = &it->second;
+        }
+        if (none) break;
+    }
+
+    auto matches = [&](uint32_t id) {
+        std::string_view k = key(id);
+        for (const std::string& term : terms) {
+            if (k.find(term) == std::string_view::npos) return false;
+        }
+        return true;
+    };
+    // Every match of a query is a match of any prefix of it, so extending
+    // the last query only rechecks its matches and the tracks added since
+    bool refine = last_valid && query.compare(0, last_query.size(), last_query) == 0;
+    size_t refine_size = refine ? last_matches.size() + (count - last_track_count) : SIZE_MAX;
+    size_t checked = 0;
+    auto cancelled = [&] {
+        return ++checked % SEARCH_CANCEL_CHECK == 0 && generation.load() != query_generation;
+    };
+
+    if (none) {
+        // No candidates at all
+    } else if (refine && refine_size <= (rarest ? rarest->size() : count)) {
+        for (uint32_t id : last_matches) {
+            if (cancelled()) return false;
+            if (matches(id)) out.push_back(id);
+        }
+        for (uint32_t id = last_track_count; id < count; ++id) {
+            if (cancelled()) return false;
+            if (matches(id)) out.push_back(id);
+        }
+    } else if (rarest) {
+        for (uint32_t id : *rarest) {
+            if (cancelled()) return false;
+            if (matches(id)) out.push_back(id);
+        }
+    } else {
+        // Only one- and two-letter terms: check every track
+        for (uint32_t id = 0; id < count; ++id) {
+            if (cancelled()) return false;
+            if (matches(id)) out.push_back(id);
+        }
+    }
+
+    last_query = query;
+    last_matches = out;
+    last_track_count = count;
+    last_valid = true;
+    return true;
+}
+
+void LibrarySearch::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return stopping || query_waiting || !pending_docs.empty(); });
+        if (stopping) return;
+
+        std::vector<std::string> docs;
+        docs.swap(pending_docs);
+        // Tracks that arrive while a query is showing rerun it against
+        // just the new ones
+        bool rerun = !query_waiting && last_valid;
+        if (!query_waiting && !rerun) {
+            lock.unlock();
+            ingest(docs);
+            lock.lock();
+            continue;
+        }
+        std::string query = query_waiting ? pending_query : last_query;
+        query_waiting = false;
+        uint64_t query_generation = generation.load();
+        lock.unlock();
+
+        ingest(docs);
+        if (query.find_first_not_of(' ') == std::string::npos) {
+            last_valid = false;
+            lock.lock();
+            continue;
+        }
+        size_t previous = last_matches.size();
+        std::vector<uint32_t> found;
+        bool done = match(query, query_generation, found);
+        bool publish = done && (!rerun || found.size() != previous);
+
+        lock.lock();
+        if (publish && generation.load() == query_generation) {
+            results.swap(found);
+            results_query = query;
+            results_ready = true;
+            lock.unlock();
+            if (on_results) on_results();
+            lock.lock();
+        }
+    }
+}
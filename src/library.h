@@ -0,0 +1,421 @@
+#pragma once
+// Album art, track metadata and the on-disk library index
+
+#include "common.h"
+
+// ASCII art generation settings
+const int THUMBNAIL_WIDTH = 40;
+const int THUMBNAIL_HEIGHT = 20;
+
+// --- Album Art ---
+//
+// Covers are decoded once per distinct picture with libavcodec's MJPEG and
+// PNG decoders, area-averaged down to the art panel and kept both as
+// xterm-256 colour half-block pixels (two per character cell) and as an
+// ASCII brightness ramp for terminals without colour or UTF-8.
+
+// Panel resolution in half-block pixels
+const int ART_PIXEL_WIDTH = THUMBNAIL_WIDTH;
+const int ART_PIXEL_HEIGHT = THUMBNAIL_HEIGHT * 2;
+
+struct AlbumArt {
+    std::vector<std::string> ascii; // THUMBNAIL_HEIGHT rows of THUMBNAIL_WIDTH
+    std::vector<uint8_t> cells;     // xterm-256 index per pixel, row-major; empty for the placeholder
+};
+
+// Decode a JPEG or PNG cover to packed RGB24
+bool decodeCoverImage(const char* data, size_t size, int& width, int& height, std::vector<uint8_t>& rgb);
+
+// Shown for tracks without a readable cover
+std::shared_ptr<const AlbumArt> placeholderArt();
+
+// Fit the cover into the panel keeping its aspect ratio, centred on black
+std::shared_ptr<const AlbumArt> renderAlbumArt(const std::vector<uint8_t>& rgb, int width, int height);
+
+// Rendered covers by picture content: every track of an album shares one
+// decode for as long as any of them holds it
+std::shared_ptr<const AlbumArt> albumArtFor(const char* data, size_t size);
+
+// Extract album art from MP3 file
+std::shared_ptr<const AlbumArt> extractAlbumArt(const std::string& filePath);
+
+// Everything the UI shows for a track, parsed once off the render thread
+struct TrackMeta {
+    std::string title;
+    std::string artist;
+    std::string album;
+    int duration_seconds = 0;
+    std::shared_ptr<const AlbumArt> art;
+    bool art_loaded = false;
+    int64_t mtime = 0;
+};
+
+// Read tags, duration and cover art for one file (slow: full TagLib parse)
+std::shared_ptr<TrackMeta> loadTrackMeta(const std::string& path);
+
+// Per-path metadata cache filled by a small pool of background workers.
+// lookup() never blocks on TagLib: a miss queues the path and returns null
+// until a worker has parsed it. Entries are keyed by path and re-validated
+// against the file's mtime, so edited tags are picked up on the next look.
+class MetadataCache {
+public:
+    // on_update runs on a worker thread whenever an entry lands
+    explicit MetadataCache(std::function<void()> on_update = {}, unsigned workers = 4)
+        : on_update(std::move(on_update)) {
+        for (unsigned i = 0; i < std::max(1u, workers); ++i) {
+            threads.emplace_back(&MetadataCache::worker_loop, this);
+        }
+    }
+
+    ~MetadataCache();
+
+    MetadataCache(const MetadataCache&) = delete;
+    MetadataCache& operator=(const MetadataCache&) = delete;
+
+    // Neither lookup nor prefetch allocates once the path has an entry
+    std::shared_ptr<const TrackMeta> lookup(const std::string& path);
+
+    // Warm an entry (e.g. neighbours of the selection) without reading it
+    void prefetch(const std::string& path);
+
+    // Pre-populate tags known from the library index; art is filled in
+    // lazily by the workers the first time the entry is looked up
+    void seed(const std::string& path, TrackMeta meta);
+
+private:
+    struct Entry {
+        std::shared_ptr<const TrackMeta> meta;
+        std::chrono::steady_clock::time_point checked;
+        bool pending = false;
+    };
+
+    using Node = std::pair<const std::string, Entry>;
+
+    static constexpr std::chrono::seconds REVALIDATE_AFTER{2};
+    static const size_t MAX_QUEUE = 256;
+
+    // Newest requests go first so the row under the cursor wins while
+    // scrolling; stale requests past MAX_QUEUE are dropped. The queue is a
+    // fixed ring of entry pointers: entries are never erased, and map
+    // nodes keep their address across rehashes.
+    void enqueue_locked(Node& node);
+
+    void worker_loop();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::unordered_map<std::string, Entry> entries;
+    std::array<Node*, MAX_QUEUE> queue{};
+    size_t queue_front = 0;
+    size_t queued = 0;
+    std::function<void()> on_update;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+};
+
+// --- Library Index ---
+//
+// On-disk layout (native endianness, versioned by the header):
+//   LibraryIndexHeader
+//   LibraryDirRecord   [dir_count]    sorted by path
+//   LibraryTrackRecord [track_count]  grouped by directory, sorted by path
+//   string pool        [pool_size]    bytes referenced by (offset, length)
+// The file is mapped read-only and served in place; it is only rewritten
+// when a directory's mtime shows that its contents changed.
+
+const char LIBRARY_INDEX_MAGIC[8] = {'U', 'W', 'U', 'L', 'I', 'B', '\0', '\0'};
+const uint32_t LIBRARY_INDEX_VERSION = 1;
+
+struct LibraryString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct LibraryIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dir_count;
+    uint32_t track_count;
+    uint32_t reserved;
+    uint64_t pool_size;
+};
+
+struct LibraryDirRecord {
+    LibraryString path;
+    int64_t mtime;
+    uint32_t first_track;
+    uint32_t track_count;
+};
+
+struct LibraryTrackRecord {
+    LibraryString path;
+    LibraryString title;
+    LibraryString artist;
+    LibraryString album;
+    uint64_t size;
+    int64_t mtime;
+    uint32_t duration_ms;
+    uint32_t dir_index;
+};
+
+// Owned form of a track, used while rebuilding the index
+struct LibraryTrack {
+    std::string path;
+    std::string title;
+    std::string artist;
+    std::string album;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint32_t duration_ms = 0;
+};
+
+struct LibraryDir {
+    std::string path;
+    int64_t mtime = 0;
+    std::vector<LibraryTrack> tracks;
+};
+
+// Lower-case extensions (with the dot) of every major format libsndfile was
+// built with, plus the common aliases it opens under other names
+const std::unordered_set<std::string>& supported_audio_extensions();
+
+bool is_audio_file(const fs::path& path);
+
+// Fixed set of workers, each with its own deque. Workers pop their own
+// newest task (depth-first, cache-warm) and steal the oldest task from a
+// sibling when they run dry, which keeps a deep directory tree spread
+// evenly across threads without a central queue.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned thread_count);
+
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Tasks submitted from a worker land on that worker's own deque
+    void submit(std::function<void()> task);
+
+    // Block until every task, including ones spawned by tasks, has run
+    void wait_idle();
+
+    size_t size() const { return threads.size(); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool try_take(unsigned self, std::function<void()>& task);
+
+    void worker_loop(unsigned self);
+
+    static thread_local WorkStealingPool* current_pool;
+    static thread_local unsigned current_worker;
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> outstanding{0};
+    std::atomic<unsigned> next_queue{0};
+
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+    std::condition_variable done_cv;
+    size_t queued = 0;
+    bool stopping = false;
+};
+
+// Threads used to walk and tag the library (override with UWU_SCAN_THREADS;
+// 1 reproduces a serial walk for comparison)
+unsigned scan_thread_count();
+
+// Read tags and duration for the index (no album art)
+LibraryTrack readLibraryTrack(const std::string& path, const struct stat& st);
+
+// Borrowed view of one indexed track; valid until start_rescan()
+struct LibraryTrackView {
+    std::string_view path;
+    std::string_view title;
+    std::string_view artist;
+    std::string_view album;
+    uint32_t duration_ms;
+    int64_t mtime;
+};
+
+class LibraryIndex {
+public:
+    LibraryIndex(const std::string& root, const std::string& cache_dir);
+
+    ~LibraryIndex();
+
+    LibraryIndex(const LibraryIndex&) = delete;
+    LibraryIndex& operator=(const LibraryIndex&) = delete;
+
+    // Map the existing index and stat every directory it knows about.
+    // Returns the number of directories that need a rescan.
+    size_t open();
+
+    // Visit tracks from directories the stat sweep found unchanged
+    template <typename Fn>
+    void for_each_fresh_track(Fn&& fn) const {
+        for (size_t d = 0; d < dir_count(); ++d) {
+            if (!dir_fresh[d]) continue;
+            const LibraryDirRecord& rec = dir_records()[d];
+            for (uint32_t i = rec.first_track; i < rec.first_track + rec.track_count; ++i) {
+                const LibraryTrackRecord& t = track_records()[i];
+                fn(LibraryTrackView{str(t.path), str(t.title), str(t.artist), str(t.album),
+                                    t.duration_ms, t.mtime});
+            }
+        }
+    }
+
+    // Walk the stale directories (and any new subdirectories) on a
+    // work-stealing pool in the background, streaming tracks out through
+    // take_discovered() and rewriting the index when done. The mapped
+    // views handed out by for_each_fresh_track() must not be used after
+    // this is called.
+    void start_rescan();
+
+    // Move tracks found since the last call into out
+    void take_discovered(std::vector<LibraryTrack>& out);
+
+    bool scanning() const { return scan_thread.joinable() && !scan_done; }
+    bool rescanned() const { return scan_thread.joinable(); }
+    size_t files_scanned() const { return files_seen.load(); }
+
+    double files_per_second() const;
+
+private:
+    struct StaleDir {
+        std::string path;
+        const LibraryDirRecord* previous;
+    };
+
+    size_t dir_count() const { return header ? header->dir_count : 0; }
+
+    const LibraryDirRecord* dir_records() const;
+
+    const LibraryTrackRecord* track_records() const;
+
+    std::string_view str(const LibraryString& s) const;
+
+    // Map index_path and validate it; leaves the index empty on any mismatch
+    void map();
+
+    void unmap();
+
+    void attach(const char* data, size_t len);
+
+    LibraryTrack owned_track(const LibraryTrackRecord& t) const;
+
+    LibraryDir load_dir(const LibraryDirRecord& rec) const;
+
+    // Background half of start_rescan(): fan the stale directories out
+    // over the pool, then merge with the fresh ones and save
+    void rescan();
+
+    void publish(const std::string& dir_path, LibraryTrack track);
+
+    // List one directory. Subdirectories the index has never seen are
+    // queued as new tasks (known ones are covered by the stat sweep);
+    // files whose size and mtime match the previous record keep their
+    // tags, everything else is tagged in its own task.
+    void scan_dir(WorkStealingPool& pool, const std::string& path, const LibraryDirRecord* previous);
+
+    // Serialize dirs, publish atomically (temp + rename) and remap. If the
+    // cache directory is not writable the image is served from memory.
+    void rebuild(std::vector<LibraryDir>& dirs);
+
+    std::string root;
+    std::string index_path;
+
+    std::vector<bool> dir_fresh;
+    std::vector<StaleDir> stale_dirs;
+    std::unordered_set<std::string> known_dirs;
+    bool any_removed = false;
+
+    std::thread scan_thread;
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> scan_done{false};
+    std::atomic<size_t> files_seen{0};
+    std::chrono::steady_clock::time_point scan_started;
+    std::atomic<std::chrono::steady_clock::time_point> scan_finished{};
+
+    std::mutex scanned_mutex;
+    std::unordered_map<std::string, LibraryDir> scanned;
+
+    std::mutex discovered_mutex;
+    std::vector<LibraryTrack> discovered;
+
+    void* mapped = nullptr;
+    size_t mapped_size = 0;
+    std::vector<char> image;
+    const LibraryIndexHeader* header = nullptr;
+};
+
+// --- Library Search ---
+//
+// Incremental filter over the tracks the library player lists. Title,
+// artist, album and file name are folded to ASCII lower case and indexed
+// by trigram. A track matches when every space-separated query term is a
+// substring of those fields; results keep library order.
+//
+// A worker thread owns the index and answers the newest query only: a
+// query still running when another arrives is abandoned, and one that
+// extends the previous query only rechecks the previous matches.
+
+const size_t SEARCH_CANCEL_CHECK = 4096; // candidates between cancellation checks
+
+class LibrarySearch {
+public:
+    // on_results runs on the worker whenever take_results has news
+    explicit LibrarySearch(std::function<void()> on_results);
+    ~LibrarySearch();
+
+    LibrarySearch(const LibrarySearch&) = delete;
+    LibrarySearch& operator=(const LibrarySearch&) = delete;
+
+    // Track ids count add() calls from zero, matching the player's files
+    void add(std::string_view title, std::string_view artist, std::string_view album, std::string_view path);
+
+    // An empty query ends the search; nothing more is published
+    void submit(std::string query);
+
+    // The most recent finished query and its matches, if any arrived
+    // since the last call
+    bool take_results(std::vector<uint32_t>& ids, std::string& query);
+
+private:
+    void run();
+    void ingest(std::vector<std::string>& docs);
+    // False if a newer query arrived part-way
+    bool match(const std::string& query, uint64_t generation, std::vector<uint32_t>& out);
+    std::string_view key(uint32_t id) const;
+
+    std::function<void()> on_results;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<std::string> pending_docs;
+    std::string pending_query;
+    bool query_waiting = false;
+    bool stopping = false;
+    std::atomic<uint64_t> generation{0};
+
+    bool results_ready = false;
+    std::vector<uint32_t> results;
+    std::string results_query;
+
+    // Worker only
+    std::string pool;
+    std::vector<uint32_t> key_offsets{0};
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+    std::string last_query;
+    std::vector<uint32_t> last_matches;
+    uint32_t last_track_count = 0;
+    bool last_valid = false;
+
+    std::thread worker;
+};
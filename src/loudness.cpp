@@ -0,0 +1,326 @@
+#include "loudness.h"
+
+#include "engine.h"
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+float loudness_target_lufs = -18.0f;
+bool loudness_enabled = true;
+
+LoudnessCache g_loudness;
+
+// --- Loudness Meter ---
+
+LoudnessMeter::LoudnessMeter(int rate, int channels)
+    : channels(std::max(1, channels)),
+      step_frames(static_cast<size_t>(std::max(10, rate / 10))) {
+    // BS.1770 stage 1: high shelf modelling the head, +4 dB above ~1.7 kHz
+    double fs = std::max(1, rate);
+    double k = std::tan(M_PI * 1681.974450955533 / fs);
+    double q = 0.7071752369554196;
+    double vh = std::pow(10.0, 3.999843853973347 / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    shelf = {(vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+             2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+
+    // Stage 2: RLB high-pass at ~38 Hz
+    k = std::tan(M_PI * 38.13547087602444 / fs);
+    q = 0.5003270373238773;
+    a0 = 1.0 + k / q + k * k;
+    highpass = {1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+
+    // Surrounds count 1.41, LFE not at all. Mono is measured as it plays,
+    // on both speakers.
+    weights.assign(this->channels, 1.0);
+    if (this->channels == 1) {
+        weights[0] = 2.0;
+    } else if (this->channels == 5) {
+        weights[3] = weights[4] = 1.41;
+    } else if (this->channels == 6) {
+        weights[3] = 0.0;
+        weights[4] = weights[5] = 1.41;
+    }
+    state.assign(static_cast<size_t>(this->channels) * 4, 0.0);
+}
+
+void LoudnessMeter::add(const float* frames, size_t count) {
+    for (size_t f = 0; f < count; ++f) {
+        const float* frame = frames + f * channels;
+        double energy = 0.0;
+        for (int c = 0; c < channels; ++c) {
+            float sample = frame[c];
+            sample_peak = std::max(sample_peak, std::fabs(sample));
+
+            // Transposed direct form II, one pair of delays per stage
+            double* z = &state[static_cast<size_t>(c) * 4];
+            double x = sample;
+            double y = shelf.b0 * x + z[0];
+            z[0] = shelf.b1 * x - shelf.a1 * y + z[1];
+            z[1] = shelf.b2 * x - shelf.a2 * y;
+            x = y;
+            y = highpass.b0 * x + z[2];
+            z[2] = highpass.b1 * x - highpass.a1 * y + z[3];
+            z[3] = highpass.b2 * x - highpass.a2 * y;
+            energy += weights[c] * y * y;
+        }
+        step_energy += energy;
+
+        if (++step_fill == step_frames) {
+            recent[steps % recent.size()] = step_energy;
+            steps++;
+            step_energy = 0.0;
+            step_fill = 0;
+            if (steps >= recent.size()) {
+                double sum = recent[0] + recent[1] + recent[2] + recent[3];
+                blocks.push_back(static_cast<float>(sum / (recent.size() * step_frames)));
+            }
+        }
+    }
+}
+
+double LoudnessMeter::integrated() const {
+    auto gated_mean = [this](double threshold, double& mean) {
+        double sum = 0.0;
+        size_t n = 0;
+        for (float z : blocks) {
+            if (z > threshold) {
+                sum += z;
+                n++;
+            }
+        }
+        if (n == 0) return false;
+        mean = sum / n;
+        return true;
+    };
+
+    // -0.691 dB offsets the K-weighting's gain at 1 kHz
+    double absolute = std::pow(10.0, (-70.0 + 0.691) / 10.0);
+    double mean;
+    if (!gated_mean(absolute, mean)) return NAN;
+    if (!gated_mean(std::max(absolute, mean * 0.1), mean)) return NAN;
+    return -0.691 + 10.0 * std::log10(mean);
+}
+
+float loudness_gain(float lufs, float peak) {
+    if (std::isnan(lufs)) {
+        lufs = DEFAULT_TRACK_LUFS;
+        peak = 0.0f;
+    }
+    float db = std::clamp(loudness_target_lufs - lufs, LOUDNESS_MAX_CUT_DB, LOUDNESS_MAX_BOOST_DB);
+    float gain = std::pow(10.0f, db / 20.0f);
+    if (gain > 1.0f && peak > 0.0f) {
+        float cap = std::pow(10.0f, LOUDNESS_PEAK_HEADROOM_DB / 20.0f) / peak;
+        gain = std::max(1.0f, std::min(gain, cap));
+    }
+    return gain;
+}
+
+bool measure_loudness(const std::string& path, float& lufs, float& peak, const std::atomic<bool>* stop) {
+    std::unique_ptr<AudioSource> source = open_audio_source(path);
+    if (!source) return false;
+
+    const sf_count_t chunk = 4096;
+    std::vector<float> frames(static_cast<size_t>(chunk) * source->channels());
+    LoudnessMeter meter(source->rate(), source->channels());
+    while (!(stop && stop->load())) {
+        sf_count_t got = source->read(frames.data(), chunk);
+        if (got <= 0) break;
+        meter.add(frames.data(), static_cast<size_t>(got));
+    }
+    if (stop && stop->load()) return false;
+
+    lufs = static_cast<float>(meter.integrated());
+    peak = meter.peak();
+    return true;
+}
+
+unsigned loudness_thread_count() {
+    if (const char* env = getenv("UWU_LOUDNESS_JOBS")) {
+        return std::max(1, atoi(env));
+    }
+    return std::max(1u, std::thread::hardware_concurrency() / 2);
+}
+
+// --- Loudness Cache ---
+
+void LoudnessCache::start(const std::string& file, unsigned workers) {
+    if (!threads.empty()) return;
+    cache_file = file;
+    load_file();
+    stopping = false;
+    for (unsigned i = 0; i < std::max(1u, workers); ++i) {
+        threads.emplace_back(&LoudnessCache::worker_loop, this);
+    }
+}
+
+void LoudnessCache::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& t : threads) t.join();
+    threads.clear();
+    if (fd >= 0) close(fd);
+    fd = -1;
+}
+
+// Read every record, drop a torn tail and compact once superseded records
+// outnumber live ones
+void LoudnessCache::load_file() {
+    fd = ::open(cache_file.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+
+    LoudnessCacheHeader header{};
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+              memcmp(header.magic, LOUDNESS_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+              header.version == LOUDNESS_CACHE_VERSION;
+
+    size_t count = 0;
+    if (ok) {
+        count = (static_cast<size_t>(st.st_size) - sizeof(header)) / sizeof(LoudnessRecord);
+        std::vector<LoudnessRecord> stored(count);
+        size_t bytes = count * sizeof(LoudnessRecord);
+        ok = pread(fd, stored.data(), bytes, sizeof(header)) == static_cast<ssize_t>(bytes);
+        if (ok) {
+            for (const LoudnessRecord& record : stored) records[record.path_hash] = record;
+        }
+    }
+
+    bool torn = ok && static_cast<size_t>(st.st_size) != sizeof(header) + count * sizeof(LoudnessRecord);
+    if (ok && !torn && count <= records.size() * 2 + 1024) return;
+
+    // Rewrite: fresh header plus one record per file
+    if (!ok) records.clear();
+    std::string tmp = cache_file + ".tmp";
+    int out = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool written = out >= 0;
+    if (written) {
+        memcpy(header.magic, LOUDNESS_CACHE_MAGIC, sizeof(header.magic));
+        header.version = LOUDNESS_CACHE_VERSION;
+        header.reserved = 0;
+        written = write(out, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header));
+        for (const auto& [hash, record] : records) {
+            if (!written) break;
+            written = write(out, &record, sizeof(record)) == static_cast<ssize_t>(sizeof(record));
+        }
+        close(out);
+    }
+    close(fd);
+    fd = -1;
+    if (written && rename(tmp.c_str(), cache_file.c_str()) == 0) {
+        fd = ::open(cache_file.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    } else {
+        ::unlink(tmp.c_str());
+    }
+}
+
+bool LoudnessCache::valid_locked(uint64_t hash, const struct stat& st, LoudnessRecord& out) const {
+    auto it = records.find(hash);
+    if (it == records.end() || it->second.mtime != stat_mtime_ns(st) ||
+        it->second.size != static_cast<int64_t>(st.st_size)) {
+        return false;
+    }
+    out = it->second;
+    return true;
+}
+
+void LoudnessCache::enqueue(const std::string& path, bool front) {
+    uint64_t hash = fnv1a_64(path);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (threads.empty() || stopping) return;
+        // A queued entry moves up by going in again; the worker skips the
+        // second copy once the first has measured the file
+        bool queued = !queued_hashes.insert(hash).second;
+        if (front) {
+            queue.push_front(path);
+        } else if (!queued) {
+            queue.push_back(path);
+        }
+    }
+    cv.notify_one();
+}
+
+// Bulk requests only check the hash, so queueing a whole library costs no
+// stat() calls; gain() re-validates the files that actually play
+void LoudnessCache::request(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (records.count(fnv1a_64(path))) return;
+    }
+    enqueue(path, false);
+}
+
+void LoudnessCache::prioritize(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        LoudnessRecord known;
+        if (valid_locked(fnv1a_64(path), st, known)) return;
+    }
+    enqueue(path, true);
+}
+
+bool LoudnessCache::lookup(const std::string& path, LoudnessRecord& out) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    return valid_locked(fnv1a_64(path), st, out);
+}
+
+float LoudnessCache::gain(const std::string& path) {
+    if (path.empty()) return loudness_gain(NAN, 0.0f);
+
+    LoudnessRecord record;
+    if (lookup(path, record)) return loudness_gain(record.lufs, record.peak);
+    prioritize(path);
+    return loudness_gain(NAN, 0.0f);
+}
+
+void LoudnessCache::store(const LoudnessRecord& record) {
+    std::lock_guard<std::mutex> lock(mutex);
+    records[record.path_hash] = record;
+    if (fd >= 0 && write(fd, &record, sizeof(record)) != static_cast<ssize_t>(sizeof(record))) {
+        // Keep the result in memory; the file is rebuilt on the next start
+        close(fd);
+        fd = -1;
+    }
+}
+
+void LoudnessCache::worker_loop() {
+    // Scanning is bulk work: stay out of the way of the decoder and the UI
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+
+    while (true) {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) return;
+            path = std::move(queue.front());
+            queue.pop_front();
+            queued_hashes.erase(fnv1a_64(path));
+        }
+
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) continue;
+        uint64_t hash = fnv1a_64(path);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            LoudnessRecord known;
+            if (valid_locked(hash, st, known)) continue;
+        }
+
+        float lufs = NAN;
+        float peak = 0.0f;
+        bool measured = measure_loudness(path, lufs, peak, &stopping);
+        if (stopping) return;
+        if (!measured) lufs = NAN;
+        store({hash, stat_mtime_ns(st), static_cast<int64_t>(st.st_size), lufs, peak});
+    }
+}
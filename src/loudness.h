@@ -0,0 +1,146 @@
+#pragma once
+// Loudness: EBU R128 measurement, the per-track gain cache and the
+// background scanner that fills it
+
+#include "common.h"
+
+// --- Loudness Meter ---
+//
+// Integrated loudness after ITU-R BS.1770-4: K-weighting (high shelf plus
+// RLB high-pass), mean square over 400 ms blocks with 75% overlap, an
+// absolute gate at -70 LUFS and a relative gate 10 LU below the mean of
+// the blocks that passed it.
+
+class LoudnessMeter {
+public:
+    LoudnessMeter(int rate, int channels);
+
+    // Interleaved frames at the rate and channel count given above
+    void add(const float* frames, size_t count);
+
+    // LUFS, or NaN when nothing passed the gates (silence, under 400 ms)
+    double integrated() const;
+    float peak() const { return sample_peak; }
+
+private:
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+    };
+
+    Biquad shelf{};
+    Biquad highpass{};
+    int channels;
+    std::vector<double> weights;
+    std::vector<double> state;  // per channel: shelf z1 z2, high-pass z1 z2
+
+    // Weighted sum of squares per 100 ms step; a block is the last four
+    size_t step_frames;
+    size_t step_fill = 0;
+    double step_energy = 0.0;
+    std::array<double, 4> recent{};
+    size_t steps = 0;
+    std::vector<float> blocks;  // mean square of each 400 ms block
+    float sample_peak = 0.0f;
+};
+
+// --- Loudness Cache ---
+//
+// Loudness per file, keyed by the path hash and checked against the
+// file's size and mtime. Results are appended to loudness.bin in the
+// cache directory as they come in; a file that could not be measured is
+// recorded too so it is not decoded again on every start.
+//
+// On-disk layout (native endianness, versioned by the header):
+//   LoudnessCacheHeader
+//   LoudnessRecord[]  later records replace earlier ones for the same path
+
+const char LOUDNESS_CACHE_MAGIC[8] = {'U', 'W', 'U', 'L', 'U', 'F', 'S', '\0'};
+const uint32_t LOUDNESS_CACHE_VERSION = 1;
+
+struct LoudnessCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct LoudnessRecord {
+    uint64_t path_hash;
+    int64_t mtime;
+    int64_t size;
+    float lufs;  // NaN if the file could not be measured
+    float peak;
+};
+
+// Reference level tracks are normalised to (ReplayGain 2.0 uses -18)
+extern float loudness_target_lufs;
+// Off leaves every track at unity gain and skips the limiter
+extern bool loudness_enabled;
+
+// Assumed for streams and tracks not measured yet: what streaming services
+// normalise to and where most modern masters sit
+const float DEFAULT_TRACK_LUFS = -14.0f;
+
+// Gain applied to any one track stays within these bounds; the engine's
+// soft limiter catches peaks pushed past full scale
+const float LOUDNESS_MAX_CUT_DB = -24.0f;
+const float LOUDNESS_MAX_BOOST_DB = 12.0f;
+// A boost may push the measured peak at most this far over full scale
+const float LOUDNESS_PEAK_HEADROOM_DB = 3.0f;
+
+class LoudnessCache {
+public:
+    LoudnessCache() = default;
+    ~LoudnessCache() { shutdown(); }
+
+    LoudnessCache(const LoudnessCache&) = delete;
+    LoudnessCache& operator=(const LoudnessCache&) = delete;
+
+    // Load the cache file and start `workers` scanner threads at idle
+    // priority
+    void start(const std::string& file, unsigned workers);
+    void shutdown();
+
+    // Queue a file for measuring unless it is known. prioritize() puts it
+    // ahead of everything else (the track about to play).
+    void request(const std::string& path);
+    void prioritize(const std::string& path);
+
+    // Linear gain for path, or for a stream when path is empty. Never
+    // blocks on a scan: an unmeasured file gets the default.
+    float gain(const std::string& path);
+
+    // Measured loudness for path, if known and still current
+    bool lookup(const std::string& path, LoudnessRecord& out);
+
+private:
+    bool valid_locked(uint64_t hash, const struct stat& st, LoudnessRecord& out) const;
+    void enqueue(const std::string& path, bool front);
+    void load_file();
+    void store(const LoudnessRecord& record);
+    void worker_loop();
+
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    std::unordered_map<uint64_t, LoudnessRecord> records;
+    std::unordered_set<uint64_t> queued_hashes;
+    std::deque<std::string> queue;
+    std::vector<std::thread> threads;
+    std::string cache_file;
+    int fd = -1;
+    std::atomic<bool> stopping{false};
+};
+
+// Linear gain that brings a track measured at `lufs` with sample peak
+// `peak` to loudness_target_lufs, within the bounds above
+float loudness_gain(float lufs, float peak);
+
+// Measure one file start to finish; false if it could not be decoded.
+// `stop` is polled between chunks.
+bool measure_loudness(const std::string& path, float& lufs, float& peak,
+                      const std::atomic<bool>* stop = nullptr);
+
+// Scanner threads to use (override with UWU_LOUDNESS_JOBS)
+unsigned loudness_thread_count();
+
+// Loudness of the library and of cached streams
+extern LoudnessCache g_loudness;
@@ -0,0 +1,182 @@
+#include "ui.h"
+#include "engine.h"
+#include "events.h"
+#include "online.h"
+#include "control.h"
+#include "loudness.h"
+#include "visualizer.h"
+
+#include <clocale>
+#include <ncurses.h>
+extern "C" {
+#include <libavutil/log.h>
+}
+
+int main(int argc, char** argv) {
+    bool headless = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--headless") {
+            headless = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            fprintf(stderr, "usage: %s [--headless [file|dir]...]\n", argv[0]);
+            return 2;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    // Before any thread exists, so every thread inherits the signal mask
+    if (!g_events.init(!headless)) {
+        fprintf(stderr, "Failed to set up the event loop\n");
+        return 1;
+    }
+
+    // libav would otherwise log straight over the TUI
+    av_log_set_level(AV_LOG_QUIET);
+
+    if (const char* ring_ms = getenv("UWU_RING_MS")) {
+        ring_buffer_ms = std::max(20, atoi(ring_ms));
+    }
+
+    if (const char* rate = getenv("UWU_RATE")) {
+        output_rate = std::clamp(atoi(rate), 8000, 384000);
+    }
+
+    if (const char* channels = getenv("UWU_CHANNELS")) {
+        output_channels = std::clamp(atoi(channels), 1, 8);
+    }
+
+    if (const char* start_ms = getenv("UWU_START_MS")) {
+        start_buffer_ms = std::max(0, atoi(start_ms));
+    }
+
+    if (const char* cache_mb = getenv("UWU_CACHE_MB")) {
+        cache_budget_mb = std::max(0, atoi(cache_mb));
+    }
+
+    if (const char* count = getenv("UWU_SEARCH_COUNT")) {
+        search_result_count = std::min(50, std::max(1, atoi(count)));
+    }
+    if (const char* ttl = getenv("UWU_SEARCH_TTL")) {
+        search_cache_ttl_s = std::max(0, atoi(ttl));
+    }
+
+    if (const char* prefetch = getenv("UWU_PREFETCH")) {
+        prefetch_count = std::max(0, atoi(prefetch));
+    }
+    if (const char* jobs = getenv("UWU_PREFETCH_JOBS")) {
+        prefetch_jobs = std::max(1, atoi(jobs));
+    }
+    if (const char* kbps = getenv("UWU_PREFETCH_KBPS")) {
+        prefetch_kbps = std::max(0, atoi(kbps));
+    }
+
+    if (const char* gapless = getenv("UWU_GAPLESS")) {
+        gapless_enabled = (atoi(gapless) != 0);
+    }
+
+    if (const char* mmap_io = getenv("UWU_MMAP")) {
+        mmap_enabled = (atoi(mmap_io) != 0);
+    }
+
+    if (const char* loudness = getenv("UWU_LOUDNESS")) {
+        loudness_enabled = (atoi(loudness) != 0);
+    }
+    if (const char* target = getenv("UWU_LOUDNESS_TARGET")) {
+        loudness_target_lufs = std::clamp(static_cast<float>(atof(target)), -40.0f, 0.0f);
+    }
+
+    if (const char* fps = getenv("UWU_VIS_FPS")) {
+        visualizer_fps = std::clamp(atoi(fps), 1, 120);
+    }
+
+    if (const char* art = getenv("UWU_ART")) {
+        art_color_enabled = (strcmp(art, "ascii") != 0);
+    }
+
+    if (loudness_enabled) {
+        g_loudness.start(cache_directory() + "/loudness.bin", loudness_thread_count());
+        g_engine.set_gain_lookup([](const std::string& path) { return g_loudness.gain(path); });
+    }
+
+    if (!g_engine.start()) {
+        fprintf(stderr, "Failed to initialize PipeWire playback\n");
+        return 1;
+    }
+    g_events.watch_engine(g_engine.event_fd());
+
+    const char* socket_env = getenv("UWU_SOCKET");
+    std::string socket_path = socket_env ? socket_env : default_control_socket_path();
+    if (!socket_path.empty()) {
+        if (g_control.open(socket_path)) {
+            g_events.watch_control(g_control.fd(), [] { g_control.service(); }, [] { g_control.publish(); });
+        } else {
+            fprintf(stderr, "Control socket %s unavailable (another player running?)\n", socket_path.c_str());
+            if (headless) {
+                g_loudness.shutdown();
+                g_engine.shutdown();
+                return 1;
+            }
+        }
+    }
+
+    std::unique_ptr<TelemetryDump> telemetry_dump;
+    if (const char* path = getenv("UWU_TELEMETRY")) {
+        const char* period = getenv("UWU_TELEMETRY_MS");
+        telemetry_dump = std::make_unique<TelemetryDump>(g_engine, path, period ? atoi(period) : 1000);
+        if (!telemetry_dump->ok()) {
+            fprintf(stderr, "Cannot open telemetry file %s\n", path);
+            telemetry_dump.reset();
+        }
+    }
+
+    if (headless) {
+        run_headless(paths);
+        telemetry_dump.reset();
+        g_control.close();
+        g_loudness.shutdown();
+        g_engine.shutdown();
+        g_children.terminate_all();
+        return 0;
+    }
+
+    // UTF-8 output for ncursesw; numbers keep the C locale
+    setlocale(LC_CTYPE, "");
+
+    initscr();
+    start_color();
+    init_pair(1, COLOR_YELLOW, COLOR_BLACK);
+    noecho();
+    cbreak();
+    keypad(stdscr, TRUE);
+    nodelay(stdscr, TRUE); // key reads never block; waiting is g_events' job
+    set_escdelay(25);
+    curs_set(0); // Hide the cursor
+
+    int mode = prompt_mode_selection();
+    
+    clear();
+    refresh();
+
+    if (mode == 0) { // Offline
+        std::string music_dir = run_file_browser("/home");
+        if (!music_dir.empty()) {
+            run_playback_tui(music_dir);
+        }
+    } else { // Online
+        run_online_mode();
+    }
+    
+    endwin();
+    
+    // Final cleanup of audio resources and any helper still running
+    telemetry_dump.reset();
+    g_control.close();
+    g_loudness.shutdown();
+    g_engine.shutdown();
+    g_children.terminate_all();
+
+    return 0;
+}
@@ -0,0 +1,543 @@
+#include "online.h"
+#include <spawn.h>     // for helper processes
+#include <sys/wait.h>
+
+// --- Child Processes ---
+
+pid_t ChildProcesses::spawn(const std::vector<std::string>& argv, int* stdout_fd) {
+    int pipe_fds[2];
+    if (argv.empty() || pipe2(pipe_fds, O_CLOEXEC) != 0) return -1;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    // New group led by the child; undo the UI's blocked SIGWINCH
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setpgroup(&attr, 0);
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+    posix_spawnattr_setsigmask(&attr, &no_signals);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+
+    std::vector<char*> args;
+    for (const std::string& arg : argv) args.push_back(const_cast<char*>(arg.c_str()));
+    args.push_back(nullptr);
+
+    pid_t pid = -1;
+    int rc = posix_spawnp(&pid, args[0], &actions, &attr, args.data(), environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]);
+
+    if (rc != 0) {
+        close(pipe_fds[0]);
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        children[pid] = Child{};
+    }
+    *stdout_fd = pipe_fds[0];
+    return pid;
+}
+
+int ChildProcesses::wait(pid_t pid) {
+    {
+        // Once marked, only this thread may reap pid
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = children.find(pid);
+        if (it == children.end()) return -1;
+        it->second.waited = true;
+    }
+
+    int status = 0;
+    pid_t rc;
+    do {
+        rc = waitpid(pid, &status, 0);
+    } while (rc < 0 && errno == EINTR);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        children.erase(pid);
+    }
+    return (rc == pid && WIFEXITED(status)) ? WEXITSTATUS(status) : -1;
+}
+
+void ChildProcesses::terminate(pid_t pid) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = children.find(pid);
+    if (it == children.end()) return;
+    kill(-pid, it->second.signalled ? SIGKILL : SIGTERM);
+    it->second.signalled = true;
+    reap_locked();
+}
+
+void ChildProcesses::terminate_all() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& child : children) {
+        kill(-child.first, child.second.signalled ? SIGKILL : SIGTERM);
+        child.second.signalled = true;
+    }
+    reap_locked();
+}
+
+void ChildProcesses::reap_locked() {
+    for (auto it = children.begin(); it != children.end();) {
+        int status;
+        if (it->second.signalled && !it->second.waited &&
+            waitpid(it->first, &status, WNOHANG) == it->first) {
+            it = children.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+ChildProcesses g_children;
+
+bool run_capture(const std::vector<std::string>& argv, std::string& output) {
+    int fd = -1;
+    pid_t pid = g_children.spawn(argv, &fd);
+    if (pid < 0) return false;
+
+    char buffer[4096];
+    while (true) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            output.append(buffer, n);
+        } else if (n == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    close(fd);
+    return g_children.wait(pid) == 0;
+}
+
+// --- JSON ---
+
+// Just enough JSON for yt-dlp's line-delimited output: a validating
+// recursive-descent reader over one document that decodes strings
+// (escapes and \u surrogate pairs included) and numbers, and skips any
+// other value whole, however deeply nested.
+class JsonReader {
+public:
+    explicit JsonReader(std::string_view text) : text(text) {}
+
+    // Call fn(key) for every member of the top-level object; fn must
+    // consume the value. False on malformed input or if fn fails.
+    template <typename Fn>
+    bool each_member(Fn&& fn) {
+        skip_ws();
+        if (!consume('{')) return false;
+        skip_ws();
+        if (consume('}')) return true;
+        std::string key;
+        while (true) {
+            key.clear();
+            skip_ws();
+            if (!read_string(key)) return false;
+            skip_ws();
+            if (!consume(':')) return false;
+            skip_ws();
+            if (!fn(key)) return false;
+            skip_ws();
+            if (consume('}')) return true;
+            if (!consume(',')) return false;
+        }
+    }
+
+    bool at_string() const { return pos < text.size() && text[pos] == '"'; }
+    bool at_number() const {
+        return pos < text.size() && (text[pos] == '-' || (text[pos] >= '0' && text[pos] <= '9'));
+    }
+
+    bool read_string(std::string& out) {
+        if (!consume('"')) return false;
+        while (pos < text.size()) {
+            char c = text[pos++];
+            if (c == '"') return true;
+            if (static_cast<unsigned char>(c) < 0x20) return false;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size()) return false;
+            switch (text[pos++]) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!read_hex4(cp)) return false;
+                    if (cp >= 0xD800 && cp < 0xDC00) {
+                        uint32_t low;
+                        if (text.substr(pos, 2) != "\\u") return false;
+                        pos += 2;
+                        if (!read_hex4(low) || low < 0xDC00 || low >= 0xE000) return false;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (cp >= 0xDC00 && cp < 0xE000) {
+                        return false;
+                    }
+                    append_utf8(out, cp);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool read_number(double& out) {
+        size_t start = pos;
+        if (pos < text.size() && text[pos] == '-') pos++;
+        while (pos < text.size() && std::strchr("0123456789.eE+-", text[pos])) pos++;
+        if (pos == start || pos - start > 63) return false;
+        char buf[64];
+        memcpy(buf, text.data() + start, pos - start);
+        buf[pos - start] = '\0';
+        char* end;
+        out = strtod(buf, &end);
+        return *end == '\0';
+    }
+
+    bool skip_value() {
+        skip_ws();
+        if (pos >= text.size()) return false;
+        switch (text[pos]) {
+            case '"': {
+                std::string ignored;
+                return read_string(ignored);
+            }
+            case '{':
+            case '[': {
+                if (++depth > MAX_DEPTH) return false;
+                char close = text[pos] == '{' ? '}' : ']';
+                bool object = close == '}';
+                pos++;
+                skip_ws();
+                if (!consume(close)) {
+                    while (true) {
+                        skip_ws();
+                        if (object) {
+                            std::string ignored;
+                            if (!read_string(ignored)) return false;
+                            skip_ws();
+                            if (!consume(':')) return false;
+                        }
+                        if (!skip_value()) return false;
+                        skip_ws();
+                        if (consume(close)) break;
+                        if (!consume(',')) return false;
+                    }
+                }
+                depth--;
+                return true;
+            }
+            case 't': return literal("true");
+            case 'f': return literal("false");
+            case 'n': return literal("null");
+            default: {
+                double ignored;
+                return read_number(ignored);
+            }
+        }
+    }
+
+private:
+    static const int MAX_DEPTH = 64;
+
+    void skip_ws() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    bool consume(char c) {
+        if (pos < text.size() && text[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool literal(std::string_view word) {
+        if (text.substr(pos, word.size()) != word) return false;
+        pos += word.size();
+        return true;
+    }
+
+    bool read_hex4(uint32_t& out) {
+        if (pos + 4 > text.size()) return false;
+        out = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = text[pos++];
+            out <<= 4;
+            if (c >= '0' && c <= '9') out |= c - '0';
+            else if (c >= 'a' && c <= 'f') out |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') out |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    static void append_utf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    std::string_view text;
+    size_t pos = 0;
+    int depth = 0;
+};
+
+// --- YouTube Streaming & Caching ---
+
+int search_result_count = 5;
+int search_cache_ttl_s = 600;
+
+bool parse_search_result(std::string_view line, SearchResult& out) {
+    JsonReader json(line);
+    bool ok = json.each_member([&](const std::string& key) {
+        if (json.at_string()) {
+            if (key == "id") return json.read_string(out.id);
+            if (key == "title") return json.read_string(out.title);
+            if (key == "channel" || (key == "uploader" && out.channel.empty())) {
+                out.channel.clear();
+                return json.read_string(out.channel);
+            }
+        } else if (key == "duration" && json.at_number()) {
+            double seconds;
+            if (!json.read_number(seconds)) return false;
+            out.duration_seconds = static_cast<int>(seconds);
+            return true;
+        }
+        return json.skip_value();
+    });
+    // Decoded control characters (\n, \t) would break the list layout
+    for (std::string* text : {&out.title, &out.channel}) {
+        std::replace_if(text->begin(), text->end(), [](unsigned char c) { return c < 0x20; }, ' ');
+    }
+    return ok && !out.id.empty() && !out.title.empty();
+}
+
+SearchJob::SearchJob(std::string query, int count, DoneFn on_done)
+    : on_done(std::move(on_done)) {
+    thread = std::thread(&SearchJob::run, this, std::move(query), count);
+}
+
+SearchJob::~SearchJob() {
+    cancel();
+    if (thread.joinable()) thread.join();
+}
+
+void SearchJob::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    cancelled = true;
+    if (pid > 0) g_children.terminate(pid);
+}
+
+void SearchJob::snapshot(std::vector<SearchResult>& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    out.insert(out.end(), results.begin() + std::min(out.size(), results.size()), results.end());
+}
+
+void SearchJob::run(std::string query, int count) {
+    int fd = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!cancelled) {
+            pid = g_children.spawn({"yt-dlp", "ytsearch" + std::to_string(count) + ":" + query,
+                                    "--flat-playlist", "-j", "--no-warnings"}, &fd);
+        }
+    }
+
+    if (fd >= 0) {
+        std::string pending;
+        char buffer[16384];
+        while (true) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            pending.append(buffer, n);
+
+            size_t start = 0, newline;
+            while ((newline = pending.find('\n', start)) != std::string::npos) {
+                SearchResult result;
+                if (parse_search_result(std::string_view(pending).substr(start, newline - start), result)) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    results.push_back(std::move(result));
+                }
+                start = newline + 1;
+                g_events.wake();
+            }
+            pending.erase(0, start);
+        }
+        close(fd);
+        g_children.wait(pid);
+    }
+
+    bool complete;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pid = -1;
+        complete = !cancelled;
+    }
+    if (complete && on_done) on_done(results);
+    done = true;
+    g_events.wake();
+}
+
+std::shared_ptr<SearchJob> SearchService::search(const std::string& query) {
+    std::string key = std::to_string(search_result_count) + ":" + query;
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = cache.find(key);
+        if (it != cache.end() && now - it->second.stored < ttl()) {
+            return std::make_shared<SearchJob>(it->second.results);
+        }
+    }
+
+    return std::make_shared<SearchJob>(query, search_result_count, [this, key](const std::vector<SearchResult>& results) {
+        if (results.empty()) return;
+        auto stored = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = cache.begin(); it != cache.end();) {
+            it = (stored - it->second.stored >= ttl()) ? cache.erase(it) : std::next(it);
+        }
+        cache[key] = {results, stored};
+    });
+}
+
+bool resolve_stream(const std::string& video_id, std::string& url, std::string& ext) {
+    std::string output;
+    if (!run_capture({"yt-dlp", "-f", "bestaudio[ext=m4a]/bestaudio", "--no-playlist", "--no-warnings",
+                      "--print", "ext", "--print", "url", "--",
+                      "https://youtube.com/watch?v=" + video_id}, output)) {
+        return false;
+    }
+
+    std::istringstream lines(output);
+    std::getline(lines, ext);
+    std::getline(lines, url);
+
+    // Only containers the cache manages; anything else would never be found again
+    bool known = false;
+    for (const char* e : StreamCache::EXTENSIONS) known = known || ext == e;
+    return known && url.compare(0, 4, "http") == 0;
+}
+
+int prefetch_count = 2;
+int prefetch_jobs = 2;
+int prefetch_kbps = 1024;
+
+StreamPrefetcher::StreamPrefetcher(StreamCache& cache, unsigned jobs, int64_t bytes_per_second)
+    : cache(cache), limiter(bytes_per_second) {
+    for (unsigned i = 0; i < std::max(1u, jobs); ++i) {
+        threads.emplace_back(&StreamPrefetcher::worker_loop, this);
+    }
+}
+
+StreamPrefetcher::~StreamPrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        for (auto& kv : active) kv.second->cancel();
+    }
+    cv.notify_all();
+    // Workers may be waiting on a yt-dlp lookup; the UI runs none of
+    // its own while it is tearing this down
+    g_children.terminate_all();
+    for (auto& t : threads) t.join();
+}
+
+void StreamPrefetcher::prefetch(const std::vector<std::string>& ids) {
+    std::lock_guard<std::mutex> lock(mutex);
+    wanted = std::unordered_set<std::string>(ids.begin(), ids.end());
+    queue.clear();
+    for (const std::string& id : ids) {
+        if (!busy.count(id)) queue.push_back(id);
+    }
+    for (auto& kv : active) {
+        if (!wanted.count(kv.first)) kv.second->cancel();
+    }
+    cv.notify_all();
+}
+
+std::shared_ptr<StreamDownload> StreamPrefetcher::take(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    wanted.erase(id);
+    queue.erase(std::remove(queue.begin(), queue.end(), id), queue.end());
+
+    auto it = active.find(id);
+    if (it == active.end()) return nullptr;
+    std::shared_ptr<StreamDownload> download = it->second;
+    active.erase(it);
+    download->set_rate_limit(nullptr);
+    return download;
+}
+
+void StreamPrefetcher::worker_loop() {
+    while (true) {
+        std::string id;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) return;
+            id = std::move(queue.front());
+            queue.pop_front();
+            busy.insert(id);
+        }
+        fetch(id);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        busy.erase(id);
+    }
+}
+
+void StreamPrefetcher::fetch(const std::string& id) {
+    if (cache.contains(id)) return;
+
+    std::string url, ext;
+    if (!resolve_stream(id, url, ext)) return;
+
+    auto download = std::make_shared<StreamDownload>(url, cache, id + "." + ext);
+    download->set_rate_limit(&limiter);
+    {
+        // Publish under the lock so take() either sees it or has
+        // already withdrawn the id
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping || !wanted.count(id)) return;
+        active[id] = download;
+    }
+    download->start();
+    download->wait();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = active.find(id);
+    if (it != active.end() && it->second == download) active.erase(it);
+}
@@ -0,0 +1,173 @@
+#pragma once
+// YouTube search, stream resolution and background cache warming
+
+#include "engine.h"
+#include "events.h"
+
+// Search result structure
+struct SearchResult {
+    std::string id;
+    std::string title;
+    std::string channel;
+    int duration_seconds = 0;
+};
+
+// --- Child Processes ---
+
+// Helper processes (yt-dlp) are spawned without a shell, each as the
+// leader of its own process group, so teardown signals exactly the group
+// we created and never anything else on the host. A child is collected by
+// the thread that wait()s on it; one signalled before its owner got there
+// is collected with WNOHANG, and its wait() then reports it killed.
+class ChildProcesses {
+public:
+    // Spawn argv (PATH lookup) with stdout on a pipe and stdin/stderr on
+    // /dev/null. Returns the pid and the pipe's read end in *stdout_fd,
+    // or -1 if the program couldn't be started.
+    pid_t spawn(const std::vector<std::string>& argv, int* stdout_fd);
+
+    // Block until pid exits; returns its exit code, or -1 if it was killed
+    int wait(pid_t pid);
+
+    // SIGTERM the child's group; a second call escalates to SIGKILL
+    void terminate(pid_t pid);
+
+    void terminate_all();
+
+private:
+    struct Child {
+        bool signalled = false;
+        bool waited = false; // an owner is blocked in wait()
+    };
+
+    // Collect signalled children that have exited and have no owner
+    // waiting on them yet, without blocking
+    void reap_locked();
+
+    std::mutex mutex;
+    std::unordered_map<pid_t, Child> children; // by leader pid (== pgid)
+};
+
+// Global registry of helper processes
+extern ChildProcesses g_children;
+
+// Run argv to completion and capture its stdout. Returns true if it
+// exited with status 0.
+bool run_capture(const std::vector<std::string>& argv, std::string& output);
+
+// --- YouTube Streaming & Caching ---
+
+// Results requested per search (UWU_SEARCH_COUNT) and how long a finished
+// search is answered from memory (UWU_SEARCH_TTL, in seconds)
+extern int search_result_count;
+extern int search_cache_ttl_s;
+
+// One line of `yt-dlp --flat-playlist -j` output; only top-level members
+// are looked at, so nested objects with their own "id" can't interfere
+bool parse_search_result(std::string_view line, SearchResult& out);
+
+// A yt-dlp search on its own thread. Lines are parsed as yt-dlp prints
+// them, so results can be shown while the search is still running; each
+// new result wakes the UI. Destroying the job stops the search.
+class SearchJob {
+public:
+    using DoneFn = std::function<void(const std::vector<SearchResult>&)>;
+
+    SearchJob(std::string query, int count, DoneFn on_done);
+
+    // An already finished job, e.g. answered from the cache
+    explicit SearchJob(std::vector<SearchResult> cached) : results(std::move(cached)), done(true) {}
+
+    ~SearchJob();
+
+    SearchJob(const SearchJob&) = delete;
+    SearchJob& operator=(const SearchJob&) = delete;
+
+    void cancel();
+
+    bool finished() const { return done.load(); }
+
+    // Append the results that `out` doesn't have yet
+    void snapshot(std::vector<SearchResult>& out) const;
+
+private:
+    void run(std::string query, int count);
+
+    DoneFn on_done;
+    mutable std::mutex mutex;
+    std::vector<SearchResult> results;
+    pid_t pid = -1;
+    bool cancelled = false;
+    std::atomic<bool> done{false};
+    std::thread thread;
+};
+
+// Starts searches, answering repeated queries from memory for
+// search_cache_ttl_s. Must outlive the jobs it hands out.
+class SearchService {
+public:
+    std::shared_ptr<SearchJob> search(const std::string& query);
+
+private:
+    struct Cached {
+        std::vector<SearchResult> results;
+        std::chrono::steady_clock::time_point stored;
+    };
+
+    static std::chrono::seconds ttl() { return std::chrono::seconds(search_cache_ttl_s); }
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Cached> cache;
+};
+
+// Ask yt-dlp for the direct URL and container of the best audio-only
+// format; nothing is downloaded here
+bool resolve_stream(const std::string& video_id, std::string& url, std::string& ext);
+
+// Search results warmed in the background (UWU_PREFETCH, 0 disables),
+// how many are fetched at once (UWU_PREFETCH_JOBS) and their shared
+// bandwidth cap in KiB/s (UWU_PREFETCH_KBPS, 0 for none)
+extern int prefetch_count;
+extern int prefetch_jobs;
+extern int prefetch_kbps;
+
+// Background cache warming for search results the user hasn't picked (yet).
+// At most `jobs` results are resolved and downloaded at once, and together
+// they stay under one bandwidth cap. A result that is still downloading
+// when the user selects it is handed over by take() and continues at full
+// speed, so it is never fetched twice.
+class StreamPrefetcher {
+public:
+    StreamPrefetcher(StreamCache& cache, unsigned jobs, int64_t bytes_per_second);
+
+    ~StreamPrefetcher();
+
+    StreamPrefetcher(const StreamPrefetcher&) = delete;
+    StreamPrefetcher& operator=(const StreamPrefetcher&) = delete;
+
+    // Make ids (in priority order) the wanted set; transfers for anything
+    // no longer wanted are cancelled
+    void prefetch(const std::vector<std::string>& ids);
+
+    // Claim id for the foreground: it won't be started in the background
+    // any more, and an in-flight download is returned uncapped
+    std::shared_ptr<StreamDownload> take(const std::string& id);
+
+private:
+    void worker_loop();
+
+    // Resolve and download one id unless it is cached or withdrawn
+    void fetch(const std::string& id);
+
+    StreamCache& cache;
+    RateLimiter limiter;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::string> queue;
+    std::unordered_set<std::string> wanted;
+    std::unordered_set<std::string> busy; // popped by a worker, not finished yet
+    std::unordered_map<std::string, std::shared_ptr<StreamDownload>> active;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+};
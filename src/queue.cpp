@@ -0,0 +1,387 @@
+#include "queue.h"
+
+#include "engine.h"
+#include "loudness.h"
+
+// --- Play Queue ---
+
+PlayQueue::Id PlayQueue::allocate(std::string path) {
+    Id id;
+    if (!free_slots.empty()) {
+        id = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        id = static_cast<Id>(slots.size());
+        slots.emplace_back();
+    }
+    Slot& slot = slots[id];
+    slot.path = std::move(path);
+    slot.live = true;
+    live_count++;
+    changes++;
+    return id;
+}
+
+void PlayQueue::link_after(Id id, Id after) {
+    Slot& slot = slots[id];
+    slot.prev = after;
+    slot.next = after == NONE ? head : slots[after].next;
+    if (slot.next != NONE) slots[slot.next].prev = id; else tail = id;
+    if (after != NONE) slots[after].next = id; else head = id;
+}
+
+void PlayQueue::unlink(Id id) {
+    Slot& slot = slots[id];
+    if (slot.prev != NONE) slots[slot.prev].next = slot.next; else head = slot.next;
+    if (slot.next != NONE) slots[slot.next].prev = slot.prev; else tail = slot.prev;
+    slot.prev = slot.next = NONE;
+}
+
+void PlayQueue::shuffle_link_after(Id id, Id after) {
+    Slot& slot = slots[id];
+    slot.shuffle_prev = after;
+    slot.shuffle_next = after == NONE ? shuffle_head : slots[after].shuffle_next;
+    if (slot.shuffle_next != NONE) slots[slot.shuffle_next].shuffle_prev = id; else shuffle_tail = id;
+    if (after != NONE) slots[after].shuffle_next = id; else shuffle_head = id;
+}
+
+void PlayQueue::shuffle_unlink(Id id) {
+    Slot& slot = slots[id];
+    if (slot.shuffle_prev != NONE) slots[slot.shuffle_prev].shuffle_next = slot.shuffle_next;
+    else shuffle_head = slot.shuffle_next;
+    if (slot.shuffle_next != NONE) slots[slot.shuffle_next].shuffle_prev = slot.shuffle_prev;
+    else shuffle_tail = slot.shuffle_prev;
+    slot.shuffle_prev = slot.shuffle_next = NONE;
+}
+
+// A uniformly chosen live slot. Free slots are reused before the table
+// grows, so a few probes nearly always hit; the fallback keeps it O(1).
+PlayQueue::Id PlayQueue::random_live() {
+    if (live_count == 0) return NONE;
+    std::uniform_int_distribution<size_t> pick(0, slots.size() - 1);
+    for (int tries = 0; tries < 64; ++tries) {
+        Id id = static_cast<Id>(pick(rng));
+        if (slots[id].live) return id;
+    }
+    return current_id != NONE ? current_id : shuffle_tail;
+}
+
+PlayQueue::Id PlayQueue::append(std::string path) {
+    // Shuffled, a new entry lands at a random point of the order
+    Id shuffle_after = shuffle_on ? random_live() : NONE;
+    Id id = allocate(std::move(path));
+    link_after(id, tail);
+    if (shuffle_on) shuffle_link_after(id, shuffle_after);
+    return id;
+}
+
+PlayQueue::Id PlayQueue::insert_after(Id after, std::string path) {
+    if (!contains(after)) after = NONE;
+    Id id = allocate(std::move(path));
+    link_after(id, after);
+    if (shuffle_on) shuffle_link_after(id, after);
+    return id;
+}
+
+void PlayQueue::remove(Id id) {
+    if (!contains(id)) return;
+    if (id == current_id || id == resume_id) {
+        Id following = next(id);
+        resume_id = following == id ? NONE : following;
+        if (id == current_id) current_id = NONE;
+    }
+    unlink(id);
+    if (shuffle_on) shuffle_unlink(id);
+    slots[id] = Slot();
+    free_slots.push_back(id);
+    live_count--;
+    changes++;
+}
+
+void PlayQueue::move_after(Id id, Id after) {
+    if (!contains(id) || id == after) return;
+    if (!contains(after)) after = NONE;
+    unlink(id);
+    link_after(id, after);
+    if (shuffle_on) {
+        shuffle_unlink(id);
+        shuffle_link_after(id, after);
+    }
+    changes++;
+}
+
+void PlayQueue::clear() {
+    slots.clear();
+    free_slots.clear();
+    live_count = 0;
+    head = tail = shuffle_head = shuffle_tail = NONE;
+    current_id = resume_id = NONE;
+    changes++;
+}
+
+void PlayQueue::set_current(Id id) {
+    current_id = contains(id) ? id : NONE;
+    resume_id = NONE;
+    changes++;
+}
+
+PlayQueue::Id PlayQueue::next(Id id) const {
+    if (!contains(id)) return NONE;
+    Id following = after(id);
+    if (following == NONE && repeat_mode == RepeatMode::All) following = first();
+    return following;
+}
+
+PlayQueue::Id PlayQueue::prev(Id id) const {
+    if (!contains(id)) return NONE;
+    Id before = shuffle_on ? slots[id].shuffle_prev : slots[id].prev;
+    if (before == NONE && repeat_mode == RepeatMode::All) before = shuffle_on ? shuffle_tail : tail;
+    return before;
+}
+
+PlayQueue::Id PlayQueue::successor() const {
+    if (current_id == NONE) return resume_id;
+    if (repeat_mode == RepeatMode::One) return current_id;
+    return next(current_id);
+}
+
+void PlayQueue::set_shuffle(bool on) {
+    if (on == shuffle_on) return;
+    shuffle_on = on;
+    changes++;
+    if (!on) return;
+
+    // Fisher-Yates over the list, then the current entry moves to the front
+    // so everything else is still to come
+    std::vector<Id> order;
+    order.reserve(live_count);
+    for (Id id = head; id != NONE; id = slots[id].next) order.push_back(id);
+    std::shuffle(order.begin(), order.end(), rng);
+    if (current_id != NONE) {
+        std::iter_swap(order.begin(), std::find(order.begin(), order.end(), current_id));
+    }
+
+    shuffle_head = shuffle_tail = NONE;
+    for (Id id : order) shuffle_link_after(id, shuffle_tail);
+}
+
+void PlayQueue::set_repeat(RepeatMode mode) {
+    repeat_mode = mode;
+    changes++;
+}
+
+bool PlayQueue::save(const std::string& file, const PlayQueueResume& resume) const {
+    // List positions stand in for slot ids, which only mean something in
+    // this process
+    std::vector<uint32_t> position(slots.size(), UINT32_MAX);
+    uint32_t count = 0;
+    for (Id id = head; id != NONE; id = slots[id].next) position[id] = count++;
+
+    Id saved_current = current_id != NONE ? current_id : resume_id;
+
+    PlayQueueHeader h = {};
+    memcpy(h.magic, PLAY_QUEUE_MAGIC, sizeof(h.magic));
+    h.version = PLAY_QUEUE_VERSION;
+    h.count = count;
+    h.current = saved_current != NONE ? position[saved_current] : UINT32_MAX;
+    h.shuffle = shuffle_on ? 1 : 0;
+    h.repeat = static_cast<uint8_t>(repeat_mode);
+    h.state = !resume.playing ? 0 : resume.paused ? 2 : 1;
+    h.position_ms = resume.position_ms;
+
+    std::vector<char> out;
+    auto append = [&out](const void* p, size_t n) {
+        out.insert(out.end(), static_cast<const char*>(p), static_cast<const char*>(p) + n);
+    };
+    append(&h, sizeof(h));
+    if (shuffle_on) {
+        for (Id id = shuffle_head; id != NONE; id = slots[id].shuffle_next) {
+            append(&position[id], sizeof(uint32_t));
+        }
+    }
+    for (Id id = head; id != NONE; id = slots[id].next) {
+        uint32_t length = static_cast<uint32_t>(slots[id].path.size());
+        append(&length, sizeof(length));
+        append(slots[id].path.data(), length);
+    }
+
+    std::string tmp = file + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    bool written = f && fwrite(out.data(), 1, out.size(), f) == out.size();
+    if (f) written = (fclose(f) == 0) && written;
+    if (written && rename(tmp.c_str(), file.c_str()) == 0) return true;
+    ::unlink(tmp.c_str());
+    return false;
+}
+
+bool PlayQueue::load(const std::string& file, PlayQueueResume& resume) {
+    clear();
+    shuffle_on = false;
+
+    std::vector<char> data;
+    FILE* f = fopen(file.c_str(), "rb");
+    if (!f) return false;
+    char buf[65536];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + got);
+    fclose(f);
+
+    PlayQueueHeader h;
+    if (data.size() < sizeof(h)) return false;
+    memcpy(&h, data.data(), sizeof(h));
+    if (memcmp(h.magic, PLAY_QUEUE_MAGIC, sizeof(h.magic)) != 0 || h.version != PLAY_QUEUE_VERSION ||
+        h.repeat > static_cast<uint8_t>(RepeatMode::One)) {
+        return false;
+    }
+    size_t offset = sizeof(h);
+
+    std::vector<uint32_t> order;
+    if (h.shuffle) {
+        if ((data.size() - offset) / sizeof(uint32_t) < h.count) return false;
+        order.resize(h.count);
+        memcpy(order.data(), data.data() + offset, h.count * sizeof(uint32_t));
+        offset += h.count * sizeof(uint32_t);
+    }
+
+    // Fresh slots are handed out in order, so list position == id
+    slots.reserve(h.count);
+    for (uint32_t i = 0; i < h.count; ++i) {
+        uint32_t length;
+        if (data.size() - offset < sizeof(length)) break;
+        memcpy(&length, data.data() + offset, sizeof(length));
+        offset += sizeof(length);
+        if (data.size() - offset < length) break;
+        append(std::string(data.data() + offset, length));
+        offset += length;
+    }
+    if (live_count != h.count || offset != data.size()) {
+        clear();
+        return false;
+    }
+
+    if (h.shuffle) {
+        std::vector<bool> seen(h.count, false);
+        for (uint32_t id : order) {
+            if (id >= h.count || seen[id]) {
+                clear();
+                return false;
+            }
+            seen[id] = true;
+            shuffle_link_after(id, shuffle_tail);
+        }
+        shuffle_on = true;
+    }
+
+    repeat_mode = static_cast<RepeatMode>(h.repeat);
+    current_id = h.current < h.count ? h.current : NONE;
+    resume.playing = h.state != 0 && current_id != NONE;
+    resume.paused = h.state == 2;
+    resume.position_ms = h.position_ms;
+    changes++;
+    return true;
+}
+
+// --- Queue Player ---
+
+std::string default_queue_path() {
+    return cache_directory() + "/queue.bin";
+}
+
+bool QueuePlayer::play(PlayQueue::Id id) {
+    if (!queue.contains(id)) return false;
+    queue.set_current(id);
+    playing_path = queue.path(id);
+    // An unreadable file leaves is_playing false; update() moves past it
+    is_playing = PlayAudio(playing_path);
+    is_paused = false;
+    seen_track_changes = g_engine.track_changes();
+    requeue();
+    return is_playing;
+}
+
+bool QueuePlayer::next() {
+    PlayQueue::Id id = queue.current() != PlayQueue::NONE ? queue.next(queue.current()) : queue.successor();
+    return id != PlayQueue::NONE && play(id);
+}
+
+bool QueuePlayer::prev() {
+    PlayQueue::Id id = queue.prev(queue.current());
+    return id != PlayQueue::NONE && play(id);
+}
+
+void QueuePlayer::stop() {
+    StopAudio();
+    playing_path.clear();
+    save();
+}
+
+void QueuePlayer::requeue() {
+    armed_version = queue.version();
+    if (playing_path.empty()) return;
+    PlayQueue::Id id = queue.successor();
+    if (id == PlayQueue::NONE) {
+        g_engine.set_next(std::string());
+        return;
+    }
+    // Measured ahead of the pre-open so the gain is known at the splice
+    g_loudness.prioritize(queue.path(id));
+    g_engine.set_next(queue.path(id));
+}
+
+void QueuePlayer::update() {
+    // The engine crossed into the pre-opened successor inside on_process
+    if (g_engine.track_changes() != seen_track_changes) {
+        seen_track_changes = g_engine.track_changes();
+        playing_path = g_engine.spliced_path();
+        PlayQueue::Id id = queue.successor();
+        if (id != PlayQueue::NONE && queue.path(id) == playing_path) queue.set_current(id);
+        requeue();
+    }
+
+    // Track ended without a splice. Unreadable entries are skipped, but
+    // never the same one twice and never more than once round the queue.
+    PlayQueue::Id failed = PlayQueue::NONE;
+    for (size_t tries = 0; !is_playing && !playing_path.empty(); ++tries) {
+        PlayQueue::Id id = queue.successor();
+        if (id == PlayQueue::NONE || id == failed || tries > queue.size()) {
+            stop();
+            break;
+        }
+        if (!play(id)) failed = id;
+    }
+
+    // Edits from keys or the control socket may have changed what's next
+    if (queue.version() != armed_version) requeue();
+
+    if (queue.version() != saved_version &&
+        std::chrono::steady_clock::now() - last_save >= std::chrono::milliseconds(QUEUE_SAVE_INTERVAL_MS)) {
+        save();
+    }
+}
+
+bool QueuePlayer::resume() {
+    PlayQueueResume state;
+    bool loaded = queue.load(state_file, state);
+    saved_version = queue.version();
+    last_save = std::chrono::steady_clock::now();
+    if (!loaded || !state.playing || !play(queue.current())) return false;
+
+    int rate = g_engine.sample_rate();
+    if (rate > 0 && state.position_ms > 0) {
+        g_engine.seek(static_cast<sf_count_t>(state.position_ms * rate / 1000));
+    }
+    is_paused = state.paused;
+    return true;
+}
+
+void QueuePlayer::save() {
+    if (state_file.empty()) return;
+    PlayQueueResume state;
+    int rate = g_engine.sample_rate();
+    state.playing = is_playing && !playing_path.empty();
+    state.paused = is_paused;
+    state.position_ms = rate > 0 ? static_cast<uint64_t>(current_frame) * 1000 / rate : 0;
+    queue.save(state_file, state);
+    saved_version = queue.version();
+    last_save = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,170 @@
+#pragma once
+// Play queue: the ordered list of what plays next, and the glue that
+// feeds it to the engine
+
+#include "common.h"
+
+#include <random>
+
+// --- Play Queue ---
+//
+// Entries sit in slots whose id stays the same for as long as the entry
+// is queued. Slots are linked into the list order and, while shuffle is
+// on, into a second shuffled order, so next/prev, insert, remove and
+// move are all O(1). Only turning shuffle on and saving walk the queue.
+
+enum class RepeatMode : uint8_t { Off, All, One };
+
+// On-disk layout (native endianness, versioned by the header):
+//   PlayQueueHeader
+//   uint32_t shuffle_order[count]  list positions, only with shuffle on
+//   per entry, in list order: uint32_t length, then the path bytes
+// Written to a temp file and renamed over the old one.
+
+const char PLAY_QUEUE_MAGIC[8] = {'U', 'W', 'U', 'Q', 'U', 'E', '\0', '\0'};
+const uint32_t PLAY_QUEUE_VERSION = 1;
+
+struct PlayQueueHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint32_t current;  // list position, UINT32_MAX for none
+    uint8_t shuffle;
+    uint8_t repeat;
+    uint8_t state;     // 0 stopped, 1 playing, 2 paused
+    uint8_t reserved;
+    uint64_t position_ms;
+};
+
+// Where playback stood when the queue was saved
+struct PlayQueueResume {
+    bool playing = false;
+    bool paused = false;
+    uint64_t position_ms = 0;
+};
+
+class PlayQueue {
+public:
+    using Id = uint32_t;
+    static constexpr Id NONE = UINT32_MAX;
+
+    size_t size() const { return live_count; }
+    bool empty() const { return live_count == 0; }
+    bool contains(Id id) const { return id < slots.size() && slots[id].live; }
+    const std::string& path(Id id) const { return slots[id].path; }
+
+    // Bumped by every change to the entries, their order or what plays next
+    uint64_t version() const { return changes; }
+
+    Id append(std::string path);
+    // after == NONE inserts at the front. With shuffle on the entry also
+    // plays right after `after`, so this doubles as "play next".
+    Id insert_after(Id after, std::string path);
+    void remove(Id id);
+    void move_after(Id id, Id after);
+    void clear();
+
+    // The entry being played. Removing it leaves no current entry, but
+    // successor() still continues with what followed it.
+    Id current() const { return current_id; }
+    void set_current(Id id);
+
+    // Play order, which is the shuffled order while shuffle is on.
+    // next/prev are manual skips and wrap only with RepeatMode::All;
+    // successor() is what plays when the current track ends.
+    Id first() const { return shuffle_on ? shuffle_head : head; }
+    Id next(Id id) const;
+    Id prev(Id id) const;
+    Id successor() const;
+
+    // Walk the play order once, ignoring repeat (for listing the queue)
+    Id after(Id id) const { return shuffle_on ? slots[id].shuffle_next : slots[id].next; }
+
+    bool shuffle() const { return shuffle_on; }
+    // Turning shuffle on deals a fresh order that starts at the current entry
+    void set_shuffle(bool on);
+    RepeatMode repeat() const { return repeat_mode; }
+    void set_repeat(RepeatMode mode);
+
+    bool save(const std::string& file, const PlayQueueResume& resume) const;
+    // Replaces the queue with the saved one; false leaves it empty
+    bool load(const std::string& file, PlayQueueResume& resume);
+
+private:
+    struct Slot {
+        std::string path;
+        Id prev = NONE;
+        Id next = NONE;
+        Id shuffle_prev = NONE;
+        Id shuffle_next = NONE;
+        bool live = false;
+    };
+
+    Id allocate(std::string path);
+    void link_after(Id id, Id after);
+    void unlink(Id id);
+    void shuffle_link_after(Id id, Id after);
+    void shuffle_unlink(Id id);
+    Id random_live();
+
+    std::vector<Slot> slots;
+    std::vector<Id> free_slots;
+    size_t live_count = 0;
+    Id head = NONE;
+    Id tail = NONE;
+    Id shuffle_head = NONE;
+    Id shuffle_tail = NONE;
+    Id current_id = NONE;
+    Id resume_id = NONE; // what follows a removed current entry
+    bool shuffle_on = false;
+    RepeatMode repeat_mode = RepeatMode::Off;
+    uint64_t changes = 0;
+    std::mt19937 rng{std::random_device{}()};
+};
+
+// --- Queue Player ---
+
+// At most one queue save per interval while things change; stopping or
+// quitting always saves
+const int QUEUE_SAVE_INTERVAL_MS = 5000;
+
+// Saved queue shared by the library player and --headless
+std::string default_queue_path();
+
+// Plays a PlayQueue through g_engine: starts entries, keeps the engine's
+// gapless successor in step with the queue and moves on when a track
+// ends. Call update() after every event loop wakeup.
+class QueuePlayer {
+public:
+    QueuePlayer(PlayQueue& queue, std::string state_file)
+        : queue(queue), state_file(std::move(state_file)) {}
+
+    bool play(PlayQueue::Id id);
+    bool next();
+    bool prev();
+    void stop();
+
+    // Follow splices and ends of tracks, hand the engine a new successor
+    // after edits, and save the queue now and then
+    void update();
+
+    // Load the saved queue and continue where it stopped (paused if it
+    // was paused). Returns false if there was nothing to resume.
+    bool resume();
+    void save();
+
+    // Path of the playing track, empty when stopped
+    const std::string& playing() const { return playing_path; }
+
+private:
+    // Re-arm the engine's pre-open with the queue's current successor
+    void requeue();
+
+    PlayQueue& queue;
+    std::string state_file;
+    std::string playing_path;
+    uint64_t seen_track_changes = 0;
+    uint64_t armed_version = 0;
+    uint64_t saved_version = 0;
+    std::chrono::steady_clock::time_point last_save{};
+};
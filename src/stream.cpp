@@ -0,0 +1,508 @@
+#include "engine.h"
+
+int cache_budget_mb = 2048;
+
+// --- Stream Cache ---
+
+StreamCache::StreamCache(std::string dir, int64_t budget_bytes)
+    : cache_dir(std::move(dir)), budget(budget_bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    load_locked();
+    reconcile_locked();
+    evict_locked();
+    save_locked();
+}
+
+std::string StreamCache::lookup(const std::string& video_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const char* ext : EXTENSIONS) {
+        std::string name = video_id + "." + ext;
+        auto it = entries.find(name);
+        if (it == entries.end() || !it->second.complete) continue;
+
+        struct stat st;
+        if (stat(path(name).c_str(), &st) != 0 || st.st_size != it->second.size) {
+            remove_locked(it);
+            save_locked();
+            continue;
+        }
+        it->second.last_used = time(nullptr);
+        save_locked();
+        return path(name);
+    }
+    return "";
+}
+
+bool StreamCache::contains(const std::string& video_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const char* ext : EXTENSIONS) {
+        auto it = entries.find(video_id + "." + ext);
+        if (it != entries.end() && it->second.complete) return true;
+    }
+    return false;
+}
+
+bool StreamCache::load_chunks(const std::string& name, int64_t length, std::vector<uint64_t>& chunks) {
+    std::lock_guard<std::mutex> lock(mutex);
+    chunks.clear();
+    auto it = entries.find(name);
+    if (length <= 0 || it == entries.end() || it->second.complete || it->second.expected != length) {
+        return false;
+    }
+
+    FILE* f = fopen(map_path(name).c_str(), "rb");
+    if (!f) return false;
+    StreamChunkHeader header{};
+    size_t words = static_cast<size_t>((length + STREAM_CHUNK_BYTES - 1) / STREAM_CHUNK_BYTES + 63) / 64;
+    chunks.resize(words);
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+              memcmp(header.magic, STREAM_CHUNK_MAGIC, sizeof(header.magic)) == 0 &&
+              header.version == STREAM_CHUNK_VERSION && header.chunk_bytes == STREAM_CHUNK_BYTES &&
+              header.length == length && fread(chunks.data(), sizeof(uint64_t), words, f) == words &&
+              fgetc(f) == EOF;
+    fclose(f);
+    if (!ok) chunks.clear();
+    return ok;
+}
+
+void StreamCache::save_chunks(const std::string& name, int64_t length, const std::vector<uint64_t>& chunks) {
+    std::string target = map_path(name);
+    std::string tmp = target + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return;
+    StreamChunkHeader header{};
+    memcpy(header.magic, STREAM_CHUNK_MAGIC, sizeof(header.magic));
+    header.version = STREAM_CHUNK_VERSION;
+    header.chunk_bytes = static_cast<uint32_t>(STREAM_CHUNK_BYTES);
+    header.length = length;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(chunks.data(), sizeof(uint64_t), chunks.size(), f) == chunks.size();
+    if (fclose(f) == 0 && ok) {
+        rename(tmp.c_str(), target.c_str());
+    } else {
+        unlink(tmp.c_str());
+    }
+}
+
+void StreamCache::begin(const std::string& name, int64_t expected) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[name];
+    total -= entry.size;
+    entry.complete = false;
+    entry.expected = expected;
+    entry.size = std::max<int64_t>(expected, 0); // reserve the space up front
+    entry.last_used = time(nullptr);
+    entry.pinned = true;
+    total += entry.size;
+    evict_locked();
+    save_locked();
+}
+
+void StreamCache::publish(const std::string& name, int64_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    unlink(map_path(name).c_str());
+    Entry& entry = entries[name];
+    total += size - entry.size;
+    entry.complete = true;
+    entry.size = size;
+    entry.expected = size;
+    entry.last_used = time(nullptr);
+    entry.pinned = false;
+    evict_locked();
+    save_locked();
+}
+
+void StreamCache::abandon(const std::string& name, int64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(name);
+    if (it == entries.end() || it->second.expected <= 0 || bytes <= 0 ||
+        access(map_path(name).c_str(), F_OK) != 0) {
+        unlink(path(name + ".part").c_str());
+        unlink(map_path(name).c_str());
+        if (it != entries.end()) remove_locked(it);
+    } else {
+        total += bytes - it->second.size;
+        it->second.size = bytes;
+        it->second.pinned = false;
+        evict_locked();
+    }
+    save_locked();
+}
+
+bool StreamCache::managed_name(const std::string& file, std::string& name, bool& partial) {
+    partial = file.size() > 5 && file.compare(file.size() - 5, 5, ".part") == 0;
+    name = partial ? file.substr(0, file.size() - 5) : file;
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos || dot == 0) return false;
+    for (const char* ext : EXTENSIONS) {
+        if (name.compare(dot + 1, std::string::npos, ext) == 0) return true;
+    }
+    return false;
+}
+
+void StreamCache::load_locked() {
+    FILE* f = fopen(path(INDEX_NAME).c_str(), "r");
+    if (!f) return;
+    char name[256];
+    int complete;
+    long long size, expected, last_used;
+    while (fscanf(f, "%d %lld %lld %lld %255s", &complete, &size, &expected, &last_used, name) == 5) {
+        Entry& entry = entries[name];
+        entry.complete = (complete != 0);
+        entry.size = size;
+        entry.expected = expected;
+        entry.last_used = last_used;
+    }
+    fclose(f);
+}
+
+void StreamCache::reconcile_locked() {
+    std::unordered_set<std::string> present;
+    std::unordered_set<std::string> maps;
+    std::error_code ec;
+    for (const auto& file : fs::directory_iterator(cache_dir, ec)) {
+        std::string filename = file.path().filename().string();
+        const std::string map_suffix = ".part.map";
+        if (filename.size() > map_suffix.size() &&
+            filename.compare(filename.size() - map_suffix.size(), map_suffix.size(), map_suffix) == 0) {
+            maps.insert(filename.substr(0, filename.size() - map_suffix.size()));
+            continue;
+        }
+        std::string name;
+        bool partial;
+        if (!managed_name(filename, name, partial)) continue;
+
+        struct stat st;
+        if (stat(file.path().c_str(), &st) != 0) continue;
+
+        auto it = entries.find(name);
+        bool valid = it != entries.end() &&
+                     (partial ? !it->second.complete && it->second.expected >= st.st_size &&
+                                    access(map_path(name).c_str(), F_OK) == 0
+                              : it->second.complete && it->second.size == st.st_size);
+        if (!valid) {
+            unlink(file.path().c_str());
+            continue;
+        }
+        // A partial is sparse: count the blocks it really holds
+        it->second.size = partial ? std::min<int64_t>(static_cast<int64_t>(st.st_blocks) * 512, st.st_size)
+                                  : st.st_size;
+        present.insert(name);
+    }
+    for (const std::string& name : maps) {
+        auto it = entries.find(name);
+        if (!present.count(name) || it == entries.end() || it->second.complete) unlink(map_path(name).c_str());
+    }
+
+    total = 0;
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (!present.count(it->first)) {
+            it = entries.erase(it);
+        } else {
+            total += it->second.size;
+            ++it;
+        }
+    }
+}
+
+void StreamCache::remove_locked(std::unordered_map<std::string, Entry>::iterator it) {
+    unlink(path(it->second.complete ? it->first : it->first + ".part").c_str());
+    if (!it->second.complete) unlink(map_path(it->first).c_str());
+    total -= it->second.size;
+    entries.erase(it);
+}
+
+void StreamCache::evict_locked() {
+    while (budget > 0 && total > budget) {
+        auto oldest = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->second.pinned) continue;
+            if (oldest == entries.end() || it->second.last_used < oldest->second.last_used) oldest = it;
+        }
+        if (oldest == entries.end()) break;
+        remove_locked(oldest);
+    }
+}
+
+void StreamCache::save_locked() {
+    std::string tmp = path(std::string(INDEX_NAME) + ".tmp");
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) return;
+    for (const auto& kv : entries) {
+        fprintf(f, "%d %lld %lld %lld %s\n", kv.second.complete ? 1 : 0,
+                static_cast<long long>(kv.second.size), static_cast<long long>(kv.second.expected),
+                static_cast<long long>(kv.second.last_used), kv.first.c_str());
+    }
+    if (fclose(f) == 0) {
+        rename(tmp.c_str(), path(INDEX_NAME).c_str());
+    } else {
+        unlink(tmp.c_str());
+    }
+}
+
+// --- Stream Downloads ---
+
+void RateLimiter::acquire(int64_t bytes, const std::atomic<bool>& cancel) {
+    if (rate <= 0) return;
+
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        next_free = std::max(next_free, now - std::chrono::seconds(1));
+        slot = next_free;
+        next_free += std::chrono::nanoseconds(bytes * 1000000000LL / rate);
+    }
+    while (!cancel && (now = std::chrono::steady_clock::now()) < slot) {
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+            slot - now, std::chrono::milliseconds(50)));
+    }
+}
+
+StreamDownload::StreamDownload(std::string url, StreamCache& cache, std::string name)
+    : url(std::move(url)), cache(cache), name(std::move(name)),
+      final_path(cache.path(this->name)), part_path(final_path + ".part") {
+    fd = ::open(part_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+}
+
+StreamDownload::~StreamDownload() {
+    cancel();
+    if (thread.joinable()) thread.join();
+    if (fd >= 0) close(fd);
+}
+
+void StreamDownload::cancel() {
+    cancelled = true;
+    cv.notify_all();
+}
+
+void StreamDownload::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return done.load(); });
+}
+
+ssize_t StreamDownload::read_at(int64_t offset, void* dst, size_t len, const std::atomic<bool>& interrupt) {
+    std::unique_lock<std::mutex> lock(mutex);
+    int64_t ready;
+    while ((ready = readable_locked(offset)) == 0 && !done && !cancelled && !interrupt) {
+        if (length >= 0 && offset >= length) return 0;
+        request_locked(offset);
+        cv.wait_for(lock, std::chrono::milliseconds(50));
+    }
+    if (interrupt) return -1;
+    if (ready == 0) {
+        bool at_end = length >= 0 ? offset >= length : offset >= received && !failed && !cancelled;
+        return at_end ? 0 : -1;
+    }
+    size_t n = static_cast<size_t>(std::min<int64_t>(len, ready));
+    lock.unlock();
+    return pread(fd, dst, n, offset);
+}
+
+int StreamDownload::check_cancel(void* opaque) {
+    return static_cast<StreamDownload*>(opaque)->cancelled.load() ? 1 : 0;
+}
+
+bool StreamDownload::has_chunk_locked(int64_t chunk) const {
+    return (chunks[static_cast<size_t>(chunk / 64)] >> (chunk % 64)) & 1;
+}
+
+int64_t StreamDownload::readable_locked(int64_t offset) const {
+    if (chunk_count == 0) return std::max<int64_t>(0, received - offset);
+    if (offset < 0 || offset >= length) return 0;
+    int64_t chunk = offset / STREAM_CHUNK_BYTES;
+    int64_t start = chunk * STREAM_CHUNK_BYTES;
+    if (has_chunk_locked(chunk)) return std::min(length.load(), start + STREAM_CHUNK_BYTES) - offset;
+    if (chunk == filling_chunk) return std::max<int64_t>(0, start + filling_bytes - offset);
+    return 0;
+}
+
+void StreamDownload::request_locked(int64_t offset) {
+    if (chunk_count == 0 || offset < 0 || offset >= length) return;
+    int64_t chunk = offset / STREAM_CHUNK_BYTES;
+    if (filling_chunk >= 0 && chunk >= filling_chunk && chunk - filling_chunk <= JUMP_CHUNKS) return;
+    wanted_chunk = chunk;
+}
+
+int64_t StreamDownload::next_missing_locked(int64_t from) const {
+    for (int64_t i = 0; i < chunk_count; ++i) {
+        int64_t chunk = (from + i) % chunk_count;
+        if (!has_chunk_locked(chunk)) return chunk;
+    }
+    return -1;
+}
+
+bool StreamDownload::write_at(const unsigned char* data, int64_t bytes, int64_t offset) {
+    while (bytes > 0) {
+        ssize_t w = pwrite(fd, data, static_cast<size_t>(bytes), offset);
+        if (w <= 0) return false;
+        data += w;
+        bytes -= w;
+        offset += w;
+    }
+    return true;
+}
+
+void StreamDownload::save_chunks() {
+    std::vector<uint64_t> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        snapshot = chunks;
+    }
+    if (fdatasync(fd) == 0) cache.save_chunks(name, length, snapshot);
+}
+
+bool StreamDownload::fetch_chunks(AVIOContext* http) {
+    std::vector<uint64_t> kept;
+    cache.load_chunks(name, length, kept);
+    int64_t count = (length + STREAM_CHUNK_BYTES - 1) / STREAM_CHUNK_BYTES;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        chunks = kept.empty() ? std::vector<uint64_t>(static_cast<size_t>(count + 63) / 64, 0) : kept;
+        chunk_count = count;
+        int64_t have = 0;
+        for (int64_t c = 0; c < count; ++c) {
+            if (has_chunk_locked(c)) have += std::min<int64_t>(STREAM_CHUNK_BYTES, length - c * STREAM_CHUNK_BYTES);
+        }
+        received = have;
+    }
+    cv.notify_all();
+    // Sparse: holes take no space until fetched
+    if (ftruncate(fd, length) != 0) return false;
+    cache.begin(name, length);
+
+    std::vector<unsigned char> buf(READ_BYTES);
+    int64_t pos = 0; // where the HTTP response currently is
+    int64_t next = 0;
+    int unsaved = 0;
+    // Cleared if the server ignores ranges: the bytes are then taken in
+    // the order they come
+    bool ranges = true;
+    while (!cancelled) {
+        int64_t chunk;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (wanted_chunk >= 0) next = wanted_chunk;
+            wanted_chunk = -1;
+            if (ranges) {
+                chunk = next_missing_locked(next);
+            } else {
+                chunk = pos < length ? pos / STREAM_CHUNK_BYTES : -1;
+            }
+            filling_chunk = chunk;
+            filling_bytes = 0;
+            if (chunk < 0) return next_missing_locked(0) < 0;
+        }
+
+        int64_t start = chunk * STREAM_CHUNK_BYTES;
+        int64_t end = std::min(length.load(), start + STREAM_CHUNK_BYTES);
+        // Anywhere but straight ahead needs a new request with a range
+        if (pos != start) {
+            if (avio_seek(http, start, SEEK_SET) == start) {
+                pos = start;
+            } else if (ranges && pos % STREAM_CHUNK_BYTES == 0) {
+                ranges = false;
+                continue;
+            } else {
+                return false;
+            }
+        }
+
+        bool moved = false;
+        while (pos < end && !cancelled) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                moved = ranges && wanted_chunk >= 0 && wanted_chunk != chunk;
+            }
+            if (moved) break;
+
+            int n = avio_read(http, buf.data(), static_cast<int>(std::min<int64_t>(READ_BYTES, end - pos)));
+            if (n <= 0 || !write_at(buf.data(), n, pos)) return false;
+            pos += n;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                filling_bytes = pos - start;
+            }
+            cv.notify_all();
+
+            if (RateLimiter* limiter = rate_limit.load()) {
+                limiter->acquire(n, cancelled);
+            }
+        }
+        // A chunk left half done is fetched again later
+        if (moved || pos < end) continue;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!has_chunk_locked(chunk)) received += end - start;
+            chunks[static_cast<size_t>(chunk / 64)] |= uint64_t(1) << (chunk % 64);
+            filling_chunk = -1;
+            next = chunk + 1;
+        }
+        cv.notify_all();
+        if (++unsaved >= MAP_SAVE_CHUNKS) {
+            save_chunks();
+            unsaved = 0;
+        }
+    }
+    return false;
+}
+
+bool StreamDownload::fetch_sequential(AVIOContext* http) {
+    cache.begin(name, -1);
+    if (ftruncate(fd, 0) != 0) return false;
+
+    std::vector<unsigned char> buf(READ_BYTES);
+    while (!cancelled) {
+        int n = avio_read(http, buf.data(), READ_BYTES);
+        if (n == AVERROR_EOF) return true;
+        if (n < 0 || !write_at(buf.data(), n, received)) return false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            received += n;
+        }
+        cv.notify_all();
+
+        if (RateLimiter* limiter = rate_limit.load()) {
+            limiter->acquire(n, cancelled);
+        }
+    }
+    return false;
+}
+
+void StreamDownload::run() {
+    bool ok = false;
+    AVIOInterruptCB interrupt_cb = {&StreamDownload::check_cancel, this};
+    AVIOContext* http = nullptr;
+
+    bool opened = fd >= 0 && avio_open2(&http, url.c_str(), AVIO_FLAG_READ, &interrupt_cb, nullptr) >= 0;
+    if (opened) {
+        int64_t content_length = avio_size(http);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            length = content_length > 0 ? content_length : -1;
+        }
+        ok = length > 0 ? fetch_chunks(http) : fetch_sequential(http);
+        avio_closep(&http);
+    }
+
+    // Durable before visible: a published name always has all its bytes
+    ok = ok && !cancelled;
+    if (ok) {
+        ok = fdatasync(fd) == 0 && rename(part_path.c_str(), final_path.c_str()) == 0;
+    }
+    if (ok) {
+        cache.publish(name, received);
+    } else {
+        if (chunk_count > 0 && received > 0) save_chunks();
+        cache.abandon(name, received);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        failed = !ok;
+        filling_chunk = -1;
+    }
+    cv.notify_all();
+}
@@ -0,0 +1,1494 @@
+#include "ui.h"
+
+#include "library.h"
+#include "engine.h"
+#include "events.h"
+#include "online.h"
+#include "loudness.h"
+#include "queue.h"
+#include "control.h"
+
+#include <clocale>
+#include <langinfo.h>
+#include <sys/inotify.h> // for the file browser cache
+#include <ncurses.h>
+
+// Blocking key read for the simple menus: sleeps in the event loop and
+// reports a terminal resize as KEY_RESIZE so the caller can redraw
+int wait_key() {
+    while (true) {
+        int ch = getch();
+        if (ch != ERR) return ch;
+        if (g_events.wait() & EventLoop::Resize) return KEY_RESIZE;
+    }
+}
+
+// --- List View ---
+
+// Cursor and viewport over a list of `count` rows. Moves are O(1) and only
+// the rows inside the viewport are ever formatted, so a list of 100k
+// entries costs the same to draw as one that fits on screen.
+class ListView {
+public:
+    explicit ListView(bool wrap = false) : wrap(wrap) {}
+
+    void set_count(size_t n) {
+        count = n;
+        if (count == 0) {
+            cursor = 0;
+            first = 0;
+        } else if (cursor >= count) {
+            cursor = count - 1;
+        }
+        scroll_to_cursor();
+    }
+
+    void set_height(int rows) {
+        height = std::max(1, rows);
+        scroll_to_cursor();
+    }
+
+    void select(size_t index) {
+        if (count == 0) return;
+        cursor = std::min(index, count - 1);
+        scroll_to_cursor();
+    }
+
+    // Arrow keys, Page Up/Down, Home and End. Returns false for other keys.
+    bool handle_key(int ch) {
+        if (count == 0) return false;
+        size_t page = static_cast<size_t>(height);
+        switch (ch) {
+            case KEY_UP:
+                if (cursor > 0) cursor--;
+                else if (wrap) cursor = count - 1;
+                break;
+            case KEY_DOWN:
+                if (cursor + 1 < count) cursor++;
+                else if (wrap) cursor = 0;
+                break;
+            case KEY_PPAGE:
+                cursor = cursor > page ? cursor - page : 0;
+                break;
+            case KEY_NPAGE:
+                cursor = std::min(count - 1, cursor + page);
+                break;
+            case KEY_HOME:
+                cursor = 0;
+                break;
+            case KEY_END:
+                cursor = count - 1;
+                break;
+            default:
+                return false;
+        }
+        scroll_to_cursor();
+        return true;
+    }
+
+    size_t selected() const { return cursor; }
+    size_t top() const { return first; }
+    size_t size() const { return count; }
+    int rows() const { return height; }
+
+    // Call row(index, screen_row, is_selected) for each visible entry
+    template <typename RowFn>
+    void for_each_visible(RowFn&& row) const {
+        size_t end = std::min(count, first + static_cast<size_t>(height));
+        for (size_t i = first; i < end; ++i) {
+            row(i, static_cast<int>(i - first), i == cursor);
+        }
+    }
+
+private:
+    void scroll_to_cursor() {
+        size_t page = static_cast<size_t>(height);
+        if (cursor < first) {
+            first = cursor;
+        } else if (cursor >= first + page) {
+            first = cursor - page + 1;
+        }
+        if (count <= page) {
+            first = 0;
+        } else if (first > count - page) {
+            first = count - page;
+        }
+    }
+
+    size_t count = 0;
+    size_t cursor = 0;
+    size_t first = 0;
+    int height = 1;
+    bool wrap;
+};
+
+// --- Online Mode ---
+
+// Get search query from user in a popup box
+std::string get_search_query(int max_y, int max_x) {
+    // Create a centered window for the search bar
+    int height = 3;
+    int width = max_x / 2;
+    int start_y = (max_y - height) / 2;
+    int start_x = (max_x - width) / 2;
+    
+    WINDOW* search_win = newwin(height, width, start_y, start_x);
+    box(search_win, 0, 0);
+    mvwprintw(search_win, 1, 1, "Search YouTube: ");
+    wrefresh(search_win);
+    
+    echo(); // Temporarily turn echo on to see what we type
+    char str[200];
+    wgetstr(search_win, str);
+    noecho(); // Turn it back off
+    
+    delwin(search_win);
+    return std::string(str);
+}
+
+// Let the user select a song from the results and return the chosen one.
+// Results are listed as the search produces them; on_results sees the list
+// each time it grows.
+SearchResult select_from_results(SearchJob& job, const std::function<void(const std::vector<SearchResult>&)>& on_results) {
+    std::vector<SearchResult> results;
+    ListView list(true);
+
+    while (true) {
+        size_t known = results.size();
+        bool done = job.finished(); // before the snapshot, so no late result is missed
+        job.snapshot(results);
+        if (results.size() != known) on_results(results);
+
+        if (done && results.empty()) {
+            erase();
+            mvprintw(0, 0, "No results found. Press any key to search again.");
+            refresh();
+            wait_key();
+            return {};
+        }
+
+        erase();
+        mvprintw(0, 0, "YouTube Search Results (Select with Enter, Esc to cancel):");
+        if (!done) mvprintw(1, 0, "Searching... %zu so far", results.size());
+        list.set_count(results.size());
+        list.set_height(LINES - 2);
+        list.for_each_visible([&](size_t i, int row, bool selected) {
+            const SearchResult& r = results[i];
+            if (selected) attron(A_REVERSE);
+            mvprintw(row + 2, 1, "%s", r.title.c_str());
+            if (r.duration_seconds > 0) printw("  (%d:%02d)", r.duration_seconds / 60, r.duration_seconds % 60);
+            if (!r.channel.empty()) printw("  %s", r.channel.c_str());
+            if (selected) attroff(A_REVERSE);
+        });
+        refresh();
+
+        // Sleep until a key, a new result or the end of the search
+        int ch = getch();
+        if (ch == ERR) {
+            g_events.wait();
+            continue;
+        }
+        if (list.handle_key(ch)) continue;
+        switch(ch) {
+            case 10: // Enter
+                if (!results.empty()) return results[list.selected()];
+                break;
+            case 27: // Escape
+                return {};
+        }
+    }
+}
+
+// Arrow-key seek step in the players
+const int SEEK_STEP_SECONDS = 10;
+
+// Arrows step by SEEK_STEP_SECONDS and 0-9 jump to that tenth of the
+// track; false for any other key
+static bool handle_seek_key(int ch) {
+    if ((ch == KEY_LEFT || ch == KEY_RIGHT) && g_engine.sample_rate() > 0) {
+        sf_count_t step = static_cast<sf_count_t>(SEEK_STEP_SECONDS) * g_engine.sample_rate();
+        g_engine.seek(std::max<sf_count_t>(0, current_frame + (ch == KEY_RIGHT ? step : -step)));
+        return true;
+    }
+    if (ch >= '0' && ch <= '9' && total_frames > 0) {
+        g_engine.seek(total_frames * (ch - '0') / 10);
+        return true;
+    }
+    return false;
+}
+
+// Stream video_id, continuing `download` if the prefetcher already started it
+void progressive_stream_youtube(const std::string& video_id, const std::string& title, StreamCache& cache,
+                                std::shared_ptr<StreamDownload> download) {
+    clear();
+    int max_y, max_x;
+    
+    StopAudio();
+    
+    getmaxyx(stdscr, max_y, max_x);
+    
+    // Create status window
+    WINDOW* status_win = newwin(6, 60, max_y/2 - 3, max_x/2 - 30);
+    box(status_win, 0, 0);
+    mvwprintw(status_win, 1, 2, "Streaming: %.50s", title.c_str());
+    mvwprintw(status_win, 2, 2, "Resolving stream...");
+    wrefresh(status_win);
+    
+    if (!download) {
+        std::string url, ext;
+        if (!resolve_stream(video_id, url, ext)) {
+            mvwprintw(status_win, 4, 2, "Failed to resolve stream!");
+            wrefresh(status_win);
+            wait_key();
+            delwin(status_win);
+            return;
+        }
+        
+        // One fetch of the original container: the decoder reads it as it
+        // arrives and the same bytes become the cache entry
+        download = std::make_shared<StreamDownload>(url, cache, video_id + "." + ext);
+        download->start();
+    }
+    
+    mvwprintw(status_win, 3, 2, "Buffering...");
+    wrefresh(status_win);
+    
+    std::unique_ptr<AudioSource> source = LibavSource::open_stream(download);
+    if (!source || !PlayAudio(std::move(source))) {
+        download->cancel();
+        mvwprintw(status_win, 4, 2, "Failed to start stream!");
+        wrefresh(status_win);
+        wait_key();
+        delwin(status_win);
+        return;
+    }
+    
+    delwin(status_win);
+    is_playing = true;
+    is_paused = false;
+    
+    // Simple playback control loop
+    clear();
+    mvprintw(0, 0, "Now Streaming: %s", title.c_str());
+    mvprintw(2, 0, "Press 'q' to stop, SPACE to pause/resume, arrows or 0-9 to seek.");
+    mvprintw(3, 0, "Streaming in real-time...");
+    g_events.set_tick(PROGRESS_TICK_MS);
+    
+    // The finished download gets measured for the next time it plays
+    bool measure_requested = false;
+    while(is_playing) {
+        int ch = getch();
+        if (ch == 'q') {
+            is_playing = false;
+        } else if (ch == ' ') {
+            is_paused = !is_paused;
+            mvprintw(4, 0, is_paused ? "PAUSED " : "PLAYING");
+            clrtoeol();
+        } else {
+            // A seek past what has arrived moves the download there
+            handle_seek_key(ch);
+        }
+        
+        // Download progress of the cache copy
+        int64_t size = download->size();
+        if (download->finished()) {
+            if (!measure_requested) g_loudness.request(download->path());
+            measure_requested = true;
+            mvprintw(5, 0, "Cached: %lld KB (complete)", static_cast<long long>(download->downloaded() / 1024));
+        } else if (size > 0) {
+            mvprintw(5, 0, "Cached: %lld / %lld KB", static_cast<long long>(download->downloaded() / 1024),
+                     static_cast<long long>(size / 1024));
+        } else {
+            mvprintw(5, 0, "Cached: %lld KB", static_cast<long long>(download->downloaded() / 1024));
+        }
+        clrtoeol();
+        
+        // Show current playback time if available
+        if (g_engine.sample_rate() > 0) {
+            long current_seconds = static_cast<long>(static_cast<float>(current_frame) / g_engine.sample_rate());
+            mvprintw(6, 0, "Time: %02ld:%02ld", current_seconds / 60, current_seconds % 60);
+            clrtoeol();
+        }
+        
+        // Decoded audio ahead of the play position
+        int buffered = g_engine.buffered_ms();
+        if (g_engine.buffering()) {
+            int target = std::max(1, g_engine.buffer_target_ms());
+            mvprintw(7, 0, "Buffering... %d%% (%d / %d ms)", std::min(100, buffered * 100 / target), buffered, target);
+        } else {
+            mvprintw(7, 0, "Buffer: %d ms, rebuffers: %llu", buffered,
+                     static_cast<unsigned long long>(g_engine.rebuffers()));
+        }
+        clrtoeol();
+        
+        // The next getch() flushes what was drawn; sleep until a key or tick
+        if (ch == ERR) g_events.wait();
+    }
+    
+    g_events.set_tick(0);
+    
+    // Stopping early keeps the partial download for resuming next time
+    StopAudio();
+    download->cancel();
+}
+
+void run_online_mode() {
+    // Define and create the cache directory
+    StreamCache cache(cache_directory(), static_cast<int64_t>(cache_budget_mb) * 1024 * 1024);
+    StreamPrefetcher prefetcher(cache, prefetch_jobs, static_cast<int64_t>(prefetch_kbps) * 1024);
+    SearchService searches;
+
+    while(true) {
+        clear();
+        int max_y, max_x;
+        getmaxyx(stdscr, max_y, max_x);
+
+        std::string query = get_search_query(max_y, max_x);
+        if (query.empty()) break; // User might have hit Ctrl+C or something
+
+        std::shared_ptr<SearchJob> search = searches.search(query);
+
+        // Warm the top results as they arrive, while the user is choosing
+        std::vector<std::string> warm;
+        SearchResult selection = select_from_results(*search, [&](const std::vector<SearchResult>& results) {
+            if (static_cast<int>(warm.size()) >= prefetch_count) return;
+            warm.clear();
+            for (size_t i = 0; i < results.size() && static_cast<int>(warm.size()) < prefetch_count; ++i) {
+                warm.push_back(results[i].id);
+            }
+            prefetcher.prefetch(warm);
+        });
+        search.reset(); // stops a search that is still running
+
+        if (selection.id.empty()) continue; // User escaped selection
+        std::shared_ptr<StreamDownload> download = prefetcher.take(selection.id);
+
+        // Check if already fully cached
+        std::string cached_file_path = cache.lookup(selection.id);
+        if (!cached_file_path.empty()) {
+            StopAudio();
+            g_loudness.request(cached_file_path);
+            
+            // File already cached, play immediately
+            is_playing = PlayAudio(cached_file_path);
+            is_paused = false;
+            
+            // Simple playback loop for cached files
+            clear();
+            mvprintw(0, 0, "Now Playing (Cached): %s", selection.title.c_str());
+            mvprintw(2, 0, "Press 'q' to stop and search again, SPACE to pause/resume, arrows or 0-9 to seek.");
+            g_events.set_tick(PROGRESS_TICK_MS);
+            
+            while(is_playing) {
+                int ch = getch();
+                if (ch == 'q') {
+                    is_playing = false;
+                } else if (ch == ' ') {
+                    is_paused = !is_paused;
+                    mvprintw(3, 0, is_paused ? "PAUSED " : "PLAYING");
+                    clrtoeol();
+                } else {
+                    handle_seek_key(ch);
+                }
+                
+                // Show current playback time if available
+                if (g_engine.sample_rate() > 0 && total_frames > 0) {
+                    long current_seconds = static_cast<long>(static_cast<float>(current_frame) / g_engine.sample_rate());
+                    long total_seconds = static_cast<long>(static_cast<float>(total_frames) / g_engine.sample_rate());
+                    mvprintw(4, 0, "Time: %02ld:%02ld / %02ld:%02ld", 
+                             current_seconds / 60, current_seconds % 60,
+                             total_seconds / 60, total_seconds % 60);
+                    clrtoeol();
+                }
+                
+                if (ch == ERR) g_events.wait();
+            }
+            g_events.set_tick(0);
+        } else {
+            // Stream progressively
+            progressive_stream_youtube(selection.id, selection.title, cache, std::move(download));
+        }
+    }
+}
+
+// --- Directory Listing Cache ---
+
+// One file browser row. The type comes from the directory entry itself
+// (d_type) and the lowercase jump key is computed once per listing.
+struct BrowserEntry {
+    std::string name;
+    std::string folded;
+    bool is_dir = false;
+};
+
+// Listings of recently visited directories, sorted directories first.
+// A listing is read once and reused until inotify reports a change in
+// that directory; where no watch could be placed (watch limit, some
+// network mounts) the directory mtime is re-checked instead, at most once
+// per MTIME_RECHECK.
+class DirectoryCache {
+public:
+    DirectoryCache() { inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); }
+
+    ~DirectoryCache() {
+        if (inotify_fd >= 0) close(inotify_fd);
+    }
+
+    DirectoryCache(const DirectoryCache&) = delete;
+    DirectoryCache& operator=(const DirectoryCache&) = delete;
+
+    // Null if the directory can't be read. The pointer stays valid until
+    // the next call.
+    const std::vector<BrowserEntry>* get(const std::string& dir) {
+        drain_events();
+
+        auto now = std::chrono::steady_clock::now();
+        Listing& listing = listings[dir];
+        if (listing.loaded && !listing.stale && listing.wd < 0 &&
+            now - listing.checked >= MTIME_RECHECK) {
+            listing.checked = now;
+            struct stat st;
+            if (stat(dir.c_str(), &st) != 0 || stat_mtime_ns(st) != listing.mtime) {
+                listing.stale = true;
+            }
+        }
+
+        if (!listing.loaded || listing.stale) {
+            if (!load(dir, listing)) {
+                forget(dir);
+                return nullptr;
+            }
+        }
+
+        listing.last_used = ++use_clock;
+        evict();
+        return &listing.entries;
+    }
+
+private:
+    struct Listing {
+        std::vector<BrowserEntry> entries;
+        int64_t mtime = 0;
+        int wd = -1;
+        bool loaded = false;
+        bool stale = false;
+        uint64_t last_used = 0;
+        std::chrono::steady_clock::time_point checked;
+    };
+
+    static const size_t MAX_DIRS = 64;
+    static constexpr std::chrono::seconds MTIME_RECHECK{1};
+
+    bool load(const std::string& dir, Listing& listing) {
+        struct stat st;
+        if (stat(dir.c_str(), &st) != 0) return false;
+
+        // Watch before reading so a change made mid-listing isn't lost
+        if (listing.wd < 0 && inotify_fd >= 0) {
+            listing.wd = inotify_add_watch(inotify_fd, dir.c_str(),
+                IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+            if (listing.wd >= 0) watched[listing.wd] = dir;
+        }
+
+        std::error_code ec;
+        fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+        if (ec) return false;
+
+        std::vector<BrowserEntry> entries;
+        for (; it != fs::directory_iterator(); it.increment(ec)) {
+            if (ec) break;
+            BrowserEntry entry;
+            entry.name = it->path().filename().string();
+            entry.folded = entry.name;
+            std::transform(entry.folded.begin(), entry.folded.end(), entry.folded.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+            // Answered from the cached d_type; only symlinks and
+            // DT_UNKNOWN filesystems cost a stat here
+            std::error_code type_ec;
+            entry.is_dir = it->is_directory(type_ec);
+            entries.push_back(std::move(entry));
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const BrowserEntry& a, const BrowserEntry& b) {
+            if (a.is_dir != b.is_dir) return a.is_dir > b.is_dir;
+            return a.name < b.name;
+        });
+
+        listing.entries = std::move(entries);
+        listing.mtime = stat_mtime_ns(st);
+        listing.loaded = true;
+        listing.stale = false;
+        listing.checked = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    void drain_events() {
+        if (inotify_fd < 0) return;
+
+        alignas(struct inotify_event) char buf[4096];
+        while (true) {
+            ssize_t n = read(inotify_fd, buf, sizeof(buf));
+            if (n <= 0) break;
+            for (char* p = buf; p < buf + n;) {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+                p += sizeof(struct inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    for (auto& kv : listings) kv.second.stale = true;
+                    continue;
+                }
+                auto w = watched.find(event->wd);
+                if (w == watched.end()) continue;
+                auto l = listings.find(w->second);
+                if (l != listings.end()) {
+                    l->second.stale = true;
+                    if (event->mask & IN_IGNORED) l->second.wd = -1;
+                }
+                if (event->mask & IN_IGNORED) watched.erase(w);
+            }
+        }
+    }
+
+    void forget(const std::string& dir) {
+        auto it = listings.find(dir);
+        if (it == listings.end()) return;
+        int wd = it->second.wd;
+        if (wd >= 0) {
+            auto w = watched.find(wd);
+            if (w != watched.end() && w->second == dir) {
+                inotify_rm_watch(inotify_fd, wd);
+                watched.erase(w);
+            }
+        }
+        listings.erase(it);
+    }
+
+    // Drop the least recently used listings beyond MAX_DIRS
+    void evict() {
+        while (listings.size() > MAX_DIRS) {
+            auto oldest = listings.begin();
+            for (auto it = listings.begin(); it != listings.end(); ++it) {
+                if (it->second.last_used < oldest->second.last_used) oldest = it;
+            }
+            forget(oldest->first);
+        }
+    }
+
+    int inotify_fd = -1;
+    uint64_t use_clock = 0;
+    std::unordered_map<std::string, Listing> listings;
+    std::unordered_map<int, std::string> watched; // wd -> directory
+};
+
+std::string run_file_browser(const std::string& start_path) {
+    std::string current_path = start_path;
+    ListView list(true);
+    DirectoryCache dir_cache;
+    std::string jump; // type-ahead prefix while jumping
+    bool jumping = false;
+
+    while (true) {
+        // Row 0 is always ".."; row i > 0 is (*entries)[i - 1]
+        const std::vector<BrowserEntry>* entries = dir_cache.get(current_path);
+        if (!entries) return "";
+        auto is_dir_row = [&](size_t i) { return i == 0 || (*entries)[i - 1].is_dir; };
+        auto row_path = [&](size_t i) {
+            fs::path dir(current_path);
+            return i == 0 ? dir.parent_path() : dir / (*entries)[i - 1].name;
+        };
+
+        clear();
+        printw("Current Directory: %s\n\n", current_path.c_str());
+        printw("Use arrow keys to navigate, '/' to jump by name, 's' to select, Enter to enter directory.\n");
+        if (jumping) printw("Jump to: %s", jump.c_str());
+
+        const int list_y = 4;
+        list.set_count(entries->size() + 1);
+        list.set_height(LINES - list_y);
+        list.for_each_visible([&](size_t i, int row, bool selected) {
+            const char* name = (i == 0) ? ".." : (*entries)[i - 1].name.c_str();
+            move(list_y + row, 0);
+            if (selected) attron(A_REVERSE);
+            
+            if (is_dir_row(i)) {
+                attron(COLOR_PAIR(1));
+                printw(" %s", name);
+                attroff(COLOR_PAIR(1));
+            } else {
+                printw(" %s", name);
+            }
+            
+            if (selected) attroff(A_REVERSE);
+        });
+        refresh();
+
+        int ch = wait_key();
+        if (jumping) {
+            if (ch == 27) { // Escape leaves jump mode only
+                jumping = false;
+                continue;
+            }
+            if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
+                if (!jump.empty()) jump.pop_back();
+                continue;
+            }
+            if (ch >= 32 && ch < 127) {
+                jump += static_cast<char>(std::tolower(ch));
+                for (size_t i = 0; i < entries->size(); ++i) {
+                    if ((*entries)[i].folded.compare(0, jump.size(), jump) == 0) {
+                        list.select(i + 1);
+                        break;
+                    }
+                }
+                continue;
+            }
+            // Any other key ends the jump and keeps its usual meaning
+            jumping = false;
+        } else if (ch == '/') {
+            jumping = true;
+            jump.clear();
+            continue;
+        }
+
+        if (list.handle_key(ch)) continue;
+        size_t highlight = list.selected();
+        switch (ch) {
+            case 10: // Enter
+                if (highlight < list.size() && is_dir_row(highlight)) {
+                    std::error_code ec;
+                    fs::path target = fs::canonical(row_path(highlight), ec);
+                    if (!ec) {
+                        current_path = target.string();
+                        list.select(0);
+                    }
+                }
+                break;
+            case 's':
+                if (highlight < list.size() && is_dir_row(highlight)) {
+                    std::error_code ec;
+                    fs::path target = fs::canonical(row_path(highlight), ec);
+                    if (!ec) return target.string();
+                }
+                break;
+            case 27: // Escape
+                return "";
+        }
+    }
+}
+
+bool art_color_enabled = true;
+
+// Telemetry overlay for the art panel: totals, callback timing and the
+// duration histogram trimmed to the buckets in use
+void telemetry_overlay(const AudioTelemetry::Snapshot& s, int rate, std::vector<std::string>& lines) {
+    auto ms = [rate](size_t frames) { return rate > 0 ? static_cast<long long>(frames * 1000 / rate) : 0LL; };
+    size_t count = 0;
+    char line[96];
+    // Lines are overwritten in place so their buffers carry over
+    auto emit = [&] {
+        if (count == lines.size()) lines.emplace_back();
+        lines[count++].assign(line);
+    };
+
+    snprintf(line, sizeof(line), "Audio telemetry (t to hide)");
+    emit();
+    snprintf(line, sizeof(line), "callbacks %llu  quantum %u @ %d Hz",
+             static_cast<unsigned long long>(s.callbacks), s.quantum, rate);
+    emit();
+    snprintf(line, sizeof(line), "frames requested %llu, delivered %llu",
+             static_cast<unsigned long long>(s.frames_requested),
+             static_cast<unsigned long long>(s.frames_delivered));
+    emit();
+    snprintf(line, sizeof(line), "short %llu  underruns %llu  no buffer %llu",
+             static_cast<unsigned long long>(s.short_callbacks),
+             static_cast<unsigned long long>(underrun_count.load()),
+             static_cast<unsigned long long>(s.out_of_buffers));
+    emit();
+    snprintf(line, sizeof(line), "ring %lld ms  low %lld ms", ms(s.ring_fill), ms(s.ring_min_fill));
+    emit();
+    snprintf(line, sizeof(line), "callback p50 <%llu us  p99 <%llu us  max %llu us",
+             static_cast<unsigned long long>(s.percentile_us(0.5)),
+             static_cast<unsigned long long>(s.percentile_us(0.99)),
+             static_cast<unsigned long long>(s.max_duration_ns / 1000));
+    emit();
+
+    int first = AudioTelemetry::HISTOGRAM_BUCKETS, last = -1;
+    uint64_t peak = 0;
+    for (int i = 0; i < AudioTelemetry::HISTOGRAM_BUCKETS; ++i) {
+        if (s.histogram[i] == 0) continue;
+        first = std::min(first, i);
+        last = i;
+        peak = std::max(peak, s.histogram[i]);
+    }
+    const int bar_width = 16;
+    static const char BAR[] = "################";
+    for (int i = first; i <= last; ++i) {
+        int bar = static_cast<int>(s.histogram[i] * bar_width / peak);
+        bool open_ended = (i == AudioTelemetry::HISTOGRAM_BUCKETS - 1);
+        snprintf(line, sizeof(line), "%s%6llu us |%-*.*s| %llu", open_ended ? ">=" : "< ",
+                 open_ended ? 1ULL << (i - 1) : 1ULL << i, bar_width, bar, BAR,
+                 static_cast<unsigned long long>(s.histogram[i]));
+        emit();
+    }
+    lines.resize(count);
+}
+
+void describe_playback(PlaybackFrame& frame, std::shared_ptr<const TrackMeta> meta) {
+    frame.info[0].assign("Now Playing:");
+    if (meta) {
+        frame.info[1].assign("Title: ").append(meta->title);
+        frame.info[2].assign("Artist: ").append(meta->artist);
+        frame.info[3].assign("Album: ").append(meta->album);
+        frame.art_meta = std::move(meta);
+    } else {
+        frame.info[1].assign("Loading tags...");
+        frame.info[2].clear();
+        frame.info[3].clear();
+        frame.art_meta.reset();
+    }
+
+    int rate = g_engine.sample_rate();
+    frame.show_progress = total_frames > 0 && rate > 0;
+    if (frame.show_progress) {
+        float progress = static_cast<float>(current_frame) / total_frames;
+        frame.percent = static_cast<int>(progress * 100);
+        frame.total_seconds = static_cast<long>(static_cast<float>(total_frames) / rate);
+        frame.current_seconds = static_cast<long>(static_cast<float>(current_frame) / rate);
+        frame.underruns = underrun_count;
+        frame.dsp_permille = static_cast<int>(std::lround(g_engine.conversion_load() * 1000.0));
+    }
+
+    frame.status.assign(is_paused ? "PAUSED. Press SPACE to resume." : "Press SPACE to pause.");
+    frame.status.append(" LEFT/RIGHT seek, 0-9 jump, n/p skip, Tab queue, t stats, v spectrum.");
+}
+
+void spectrum_panel(const SpectrumFrame& s, int bar_rows, int meter_width, PlaybackFrame& frame) {
+    frame.spectrum.resize(s.bands.size());
+    for (size_t i = 0; i < s.bands.size(); ++i) {
+        frame.spectrum[i] = static_cast<uint16_t>(std::lround(s.bands[i] * bar_rows * 8));
+    }
+    for (int c = 0; c < 2; ++c) {
+        float level = (s.peak_db[c] - SPECTRUM_FLOOR_DB) / -SPECTRUM_FLOOR_DB;
+        frame.meter_cells[c] = std::clamp(static_cast<int>(std::lround(level * meter_width)), 0, meter_width);
+        frame.meter_db[c] = static_cast<int>(std::lround(s.peak_db[c]));
+    }
+}
+
+// The list pane's rows: a list of paths, or the subset of it that a
+// search matched
+struct ListRows {
+    const std::vector<fs::path>& paths;
+    const std::vector<uint32_t>* subset = nullptr;
+
+    size_t size() const { return subset ? subset->size() : paths.size(); }
+    const fs::path& operator[](size_t i) const { return paths[source(i)]; }
+    // Index into paths of row i
+    size_t source(size_t i) const { return subset ? (*subset)[i] : i; }
+};
+
+// Retained-mode renderer for run_playback_tui. The windows persist across
+// frames and each region is repainted only when the values it shows
+// differ from the last frame; present() flushes everything that changed
+// with a single doupdate().
+class PlaybackScreen {
+public:
+    PlaybackScreen() { layout(); }
+    ~PlaybackScreen() { destroy(); }
+
+    PlaybackScreen(const PlaybackScreen&) = delete;
+    PlaybackScreen& operator=(const PlaybackScreen&) = delete;
+
+    void render(const PlaybackFrame& frame, const ListRows& files) {
+        int max_y, max_x;
+        getmaxyx(stdscr, max_y, max_x);
+        if (max_y != rows || max_x != cols) {
+            layout();
+        }
+
+        if (force || frame.header != last.header) {
+            werase(header_win);
+            mvwaddnstr(header_win, 0, 0, frame.header.c_str(), cols);
+            wnoutrefresh(header_win);
+        }
+
+        draw_list(frame, files);
+
+        if (force || frame.info != last.info) {
+            werase(info_win);
+            for (size_t i = 0; i < frame.info.size(); ++i) {
+                mvwaddnstr(info_win, i, 0, frame.info[i].c_str(), inner_width);
+            }
+            wnoutrefresh(info_win);
+        }
+
+        bool art_changed = frame.show_spectrum ? frame.spectrum.size() != last.spectrum.size()
+                                               : frame.art_meta != last.art_meta;
+        if (art_win && (force || art_changed || frame.show_spectrum != last.show_spectrum ||
+                        frame.telemetry != last.telemetry)) {
+            werase(art_win);
+            if (!frame.telemetry.empty()) {
+                for (size_t i = 0; i < frame.telemetry.size() && static_cast<int>(i) < getmaxy(art_win); ++i) {
+                    mvwaddnstr(art_win, i, 0, frame.telemetry[i].c_str(), inner_width);
+                }
+            } else if (frame.show_spectrum) {
+                draw_spectrum(frame, true);
+            } else if (frame.art_meta && frame.art_meta->art) {
+                draw_art(*frame.art_meta->art);
+            }
+            wnoutrefresh(art_win);
+        } else if (art_win && frame.show_spectrum && draw_spectrum(frame, false)) {
+            wnoutrefresh(art_win);
+        }
+
+        if (progress_win && (force || progress_changed(frame))) {
+            werase(progress_win);
+            if (frame.show_progress) {
+                int bar_width = std::min(THUMBNAIL_WIDTH, cols / 2 - 4);
+                int fill = bar_width * frame.percent / 100;
+                mvwaddch(progress_win, 0, 0, '[');
+                for (int i = 0; i < bar_width; ++i) {
+                    waddch(progress_win, i < fill ? '#' : '-');
+                }
+                wprintw(progress_win, "] %d%%", frame.percent);
+
+                mvwprintw(progress_win, 1, 0, "%02ld:%02ld / %02ld:%02ld",
+                          frame.current_seconds / 60, frame.current_seconds % 60,
+                          frame.total_seconds / 60, frame.total_seconds % 60);
+                if (frame.underruns > 0) {
+                    wprintw(progress_win, "  underruns: %llu",
+                            static_cast<unsigned long long>(frame.underruns));
+                }
+                if (frame.dsp_permille > 0) {
+                    wprintw(progress_win, "  dsp: %d.%d%%", frame.dsp_permille / 10, frame.dsp_permille % 10);
+                }
+            }
+            wnoutrefresh(progress_win);
+        }
+
+        if (force || frame.status != last.status) {
+            werase(status_win);
+            mvwaddnstr(status_win, 0, 0, frame.status.c_str(), inner_width);
+            wnoutrefresh(status_win);
+        }
+
+        last = frame;
+        force = false;
+        doupdate();
+    }
+
+    int list_height() const { return getmaxy(list_win); }
+
+    // Spectrum layout inside the art panel: bars one column each above two
+    // meter rows (when there is room for them), 0 without an art panel
+    int spectrum_columns() const { return art_win ? getmaxx(art_win) : 0; }
+    int spectrum_bar_rows() const {
+        int height = art_win ? getmaxy(art_win) : 0;
+        return height > METER_ROWS + 1 ? height - METER_ROWS : height;
+    }
+    int meter_width() const { return std::max(1, spectrum_columns() - METER_LABEL_COLUMNS); }
+
+private:
+    bool progress_changed(const PlaybackFrame& frame) const {
+        return frame.show_progress != last.show_progress || frame.percent != last.percent ||
+               frame.current_seconds != last.current_seconds ||
+               frame.total_seconds != last.total_seconds || frame.underruns != last.underruns ||
+               frame.dsp_permille != last.dsp_permille;
+    }
+
+    // Bars are columns of eighth blocks; unless `full`, only the columns
+    // and meters that changed since the last frame are painted. Returns
+    // whether anything was.
+    bool draw_spectrum(const PlaybackFrame& frame, bool full) {
+        static const char* const EIGHTHS[] = {" ", "\xE2\x96\x81", "\xE2\x96\x82", "\xE2\x96\x83", "\xE2\x96\x84",
+                                              "\xE2\x96\x85", "\xE2\x96\x86", "\xE2\x96\x87", "\xE2\x96\x88"};
+        int bar_rows = spectrum_bar_rows();
+        int columns = std::min<int>(frame.spectrum.size(), spectrum_columns());
+        bool drew = false;
+
+        for (int x = 0; x < columns; ++x) {
+            if (!full && frame.spectrum[x] == last.spectrum[x]) continue;
+            for (int r = 0; r < bar_rows; ++r) {
+                int fill = std::clamp(static_cast<int>(frame.spectrum[x]) - r * 8, 0, 8);
+                mvwaddstr(art_win, bar_rows - 1 - r, x, utf8 ? EIGHTHS[fill] : (fill >= 4 ? "#" : " "));
+            }
+            drew = true;
+        }
+
+        if (getmaxy(art_win) > bar_rows) {
+            for (int c = 0; c < 2; ++c) {
+                if (!full && frame.meter_cells[c] == last.meter_cells[c] && frame.meter_db[c] == last.meter_db[c]) {
+                    continue;
+                }
+                wmove(art_win, bar_rows + c, 0);
+                wclrtoeol(art_win);
+                waddstr(art_win, c == 0 ? "L " : "R ");
+                for (int i = 0; i < meter_width(); ++i) {
+                    waddch(art_win, i < frame.meter_cells[c] ? '#' : '-');
+                }
+                wprintw(art_win, " %3d dB", frame.meter_db[c]);
+                drew = true;
+            }
+        }
+        return drew;
+    }
+
+    void draw_art(const AlbumArt& art) {
+        if (color_art && !art.cells.empty() && draw_half_blocks(art)) return;
+        werase(art_win);
+        for (size_t i = 0; i < art.ascii.size() && static_cast<int>(i) < getmaxy(art_win); ++i) {
+            mvwaddnstr(art_win, i, 0, art.ascii[i].c_str(), inner_width);
+        }
+    }
+
+    // One U+2580 per cell: upper pixel as foreground, lower as background.
+    // Colour pairs are handed out per drawn cover; returns false if the
+    // terminal runs out of them.
+    bool draw_half_blocks(const AlbumArt& art) {
+        int max_pairs = std::min(COLOR_PAIRS, 32767);
+        int width = std::min(THUMBNAIL_WIDTH, inner_width);
+        int height = std::min(THUMBNAIL_HEIGHT, getmaxy(art_win));
+        // Bumping the stamp forgets every pair handed out for the last cover
+        if (++art_stamp == 0) {
+            std::fill(art_pair_stamp.begin(), art_pair_stamp.end(), 0);
+            art_stamp = 1;
+        }
+        int next_pair = ART_PAIR_BASE;
+
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                uint8_t upper = art.cells[static_cast<size_t>(y * 2) * ART_PIXEL_WIDTH + x];
+                uint8_t lower = art.cells[static_cast<size_t>(y * 2 + 1) * ART_PIXEL_WIDTH + x];
+                uint16_t key = static_cast<uint16_t>(upper << 8 | lower);
+                if (art_pair_stamp[key] != art_stamp) {
+                    if (next_pair >= max_pairs) {
+                        wattr_set(art_win, A_NORMAL, 0, nullptr);
+                        return false;
+                    }
+                    init_pair(static_cast<short>(next_pair), upper, lower);
+                    art_pair_stamp[key] = art_stamp;
+                    art_pair[key] = static_cast<short>(next_pair++);
+                }
+                wattr_set(art_win, A_NORMAL, art_pair[key], nullptr);
+                mvwaddstr(art_win, y, x, "\xE2\x96\x80");
+            }
+        }
+        wattr_set(art_win, A_NORMAL, 0, nullptr);
+        return true;
+    }
+
+    // Paint files[index] at its viewport row; rows outside the viewport
+    // are never formatted
+    void draw_row(size_t index, size_t top, const ListRows& files, const PlaybackFrame& frame) {
+        if (index < top || index >= top + getmaxy(list_win)) return;
+        int row = static_cast<int>(index - top);
+        wmove(list_win, row, 0);
+        wclrtoeol(list_win);
+        if (index >= files.size()) return;
+
+        attr_t attrs = (index == frame.selected ? A_REVERSE : 0) | (index == frame.marked ? A_BOLD : 0);
+        if (attrs) wattron(list_win, attrs);
+        // The file name is the tail of the native path; no copy needed
+        const std::string& path = files[index].native();
+        waddnstr(list_win, path.c_str() + path.rfind('/') + 1, getmaxx(list_win));
+        if (attrs) wattroff(list_win, attrs);
+    }
+
+    // Entries never move once listed, so unless the viewport scrolled or
+    // the list was replaced only the two rows whose highlight changed and
+    // newly discovered rows that land inside the viewport need painting
+    void draw_list(const PlaybackFrame& frame, const ListRows& files) {
+        size_t height = getmaxy(list_win);
+        size_t top = frame.list_top;
+        bool dirty = false;
+
+        if (force || top != last.list_top || frame.list_version != last.list_version) {
+            werase(list_win);
+            for (size_t i = top; i < top + height; ++i) draw_row(i, top, files, frame);
+            dirty = true;
+        } else {
+            if (frame.selected != last.selected) {
+                draw_row(last.selected, top, files, frame);
+                draw_row(frame.selected, top, files, frame);
+                dirty = true;
+            }
+            for (size_t i = std::max(listed_count, top); i < std::min(files.size(), top + height); ++i) {
+                draw_row(i, top, files, frame);
+                dirty = true;
+            }
+        }
+        listed_count = files.size();
+
+        if (dirty) wnoutrefresh(list_win);
+    }
+
+    void destroy() {
+        for (WINDOW** w : {&status_win, &progress_win, &art_win, &info_win, &frame_win, &list_win, &header_win}) {
+            if (*w) {
+                delwin(*w);
+                *w = nullptr;
+            }
+        }
+    }
+
+    // Right column: a boxed frame with sub-windows for the tag lines, the
+    // album art, the progress bar and the key hint at the bottom
+    void layout() {
+        destroy();
+        getmaxyx(stdscr, rows, cols);
+
+        int left = cols / 2;
+        int right = cols - left;
+        inner_width = std::max(1, right - 2);
+        utf8 = strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+        color_art = art_color_enabled && has_colors() && COLORS >= 256 && utf8;
+
+        header_win = newwin(1, left, 0, 0);
+        list_win = newwin(std::max(1, rows - 2), left, 2, 0);
+        frame_win = newwin(rows, right, 0, left);
+        box(frame_win, 0, 0);
+
+        info_win = derwin(frame_win, 4, inner_width, 1, 1);
+        int art_y = 6;
+        int progress_y = art_y + THUMBNAIL_HEIGHT + 1;
+        int art_rows = std::min(THUMBNAIL_HEIGHT, rows - 8 - art_y);
+        art_win = art_rows > 0 ? derwin(frame_win, art_rows, inner_width, art_y, 1) : nullptr;
+        progress_win = progress_y < rows - 4 ? derwin(frame_win, 2, inner_width, progress_y, 1) : nullptr;
+        status_win = derwin(frame_win, 1, inner_width, std::max(1, rows - 2), 1);
+
+        erase();
+        wnoutrefresh(stdscr);
+        wnoutrefresh(frame_win);
+        force = true;
+    }
+
+    WINDOW* header_win = nullptr;
+    WINDOW* list_win = nullptr;
+    WINDOW* frame_win = nullptr;
+    WINDOW* info_win = nullptr;
+    WINDOW* art_win = nullptr;
+    WINDOW* progress_win = nullptr;
+    WINDOW* status_win = nullptr;
+
+    int rows = 0;
+    int cols = 0;
+    int inner_width = 1;
+    size_t listed_count = 0;
+    bool force = true;
+    PlaybackFrame last;
+
+    // Half-block covers need 256 colours and a UTF-8 locale; without UTF-8
+    // spectrum bars fall back to '#'
+    static const int ART_PAIR_BASE = 16;
+    bool utf8 = false;
+    bool color_art = false;
+
+    // "L " before a meter and " -72 dB" after it
+    static const int METER_ROWS = 2;
+    static const int METER_LABEL_COLUMNS = 9;
+    // Colour pair per (upper, lower) colour combination, valid where the
+    // stamp matches the current cover
+    std::vector<short> art_pair = std::vector<short>(1 << 16);
+    std::vector<uint32_t> art_pair_stamp = std::vector<uint32_t>(1 << 16);
+    uint32_t art_stamp = 0;
+};
+
+void run_playback_tui(const std::string& music_directory) {
+    std::vector<fs::path> files;
+    
+    if (!fs::exists(music_directory) || !fs::is_directory(music_directory)) return;
+
+    // Tags and art are only ever read from here; workers do the parsing
+    MetadataCache meta_cache([] { g_events.wake(); });
+    LibrarySearch search([] { g_events.wake(); });
+
+    auto add_track = [&](std::string_view path, std::string_view title, std::string_view artist,
+                         std::string_view album, uint32_t duration_ms, int64_t mtime) {
+        files.emplace_back(path);
+        search.add(title, artist, album, path);
+        g_loudness.request(files.back().string());
+
+        TrackMeta meta;
+        meta.title = std::string(title);
+        meta.artist = std::string(artist);
+        meta.album = std::string(album);
+        meta.duration_seconds = static_cast<int>(duration_ms / 1000);
+        meta.mtime = mtime;
+        meta_cache.seed(files.back().string(), std::move(meta));
+    };
+
+    // Startup is a mmap of the saved index plus a stat of each directory.
+    // Unchanged directories are listed straight away; changed and new ones
+    // are walked in the background and stream in while the UI is live.
+    mvprintw(0, 0, "Loading library index...");
+    refresh();
+    LibraryIndex library(music_directory, cache_directory());
+    library.open();
+    library.for_each_fresh_track([&](const LibraryTrackView& t) {
+        add_track(t.path, t.title, t.artist, t.album, t.duration_ms, t.mtime);
+    });
+    library.start_rescan();
+    std::vector<LibraryTrack> discovered;
+
+    ListView list;
+    ListView queue_list;
+    bool show_queue = false;
+
+    // '/' filters the library as you type; matches arrive from the search
+    // worker and are shown by index into files
+    ListView search_list;
+    bool searching = false;
+    std::string search_query;
+    std::string matched_query;
+    std::vector<uint32_t> search_matches;
+    uint64_t search_version = 0;
+
+    // Enter plays the library from the selected track onwards; e/E add to
+    // the queue without replacing it. The saved queue resumes on startup.
+    PlayQueue queue;
+    QueuePlayer player(queue, default_queue_path());
+    player.resume();
+
+    // The queue view lists the queue in play order, rebuilt only when it changes
+    std::vector<fs::path> queue_rows;
+    std::vector<PlayQueue::Id> queue_ids;
+    uint64_t queue_rows_version = ~uint64_t(0);
+
+    auto play_library_from = [&](size_t index) {
+        bool shuffled = queue.shuffle();
+        queue.set_shuffle(false);
+        queue.clear();
+        PlayQueue::Id start = PlayQueue::NONE;
+        for (size_t i = 0; i < files.size(); ++i) {
+            PlayQueue::Id id = queue.append(files[i].string());
+            if (i == index) start = id;
+        }
+        queue.set_current(start);
+        queue.set_shuffle(shuffled);
+        return player.play(start);
+    };
+
+    bool quit_requested = false;
+    ControlServer::Transport transport = queue_transport(queue, player);
+    transport.play = [&, play_queued = transport.play](const std::string& path) {
+        if (path.empty() && queue.empty()) {
+            size_t selected = list.selected();
+            return selected < files.size() && play_library_from(selected);
+        }
+        return play_queued(path);
+    };
+    transport.quit = [&] { quit_requested = true; };
+    ControlServer::Scope scope(g_control, transport);
+
+    PlaybackScreen screen;
+    PlaybackFrame frame;
+    int ch = ERR;
+    bool show_telemetry = false;
+
+    // 'v' swaps the art for a spectrum; the analyzer, and with it the
+    // engine's output tap, only runs while the spectrum is on screen
+    SpectrumAnalyzer analyzer(g_engine, [] { g_events.wake(); });
+    SpectrumFrame spectrum;
+    bool show_spectrum = false;
+
+    while (true) {
+        if ((ch == 27 && !searching) || quit_requested) break; // Escape to exit
+
+        discovered.clear();
+        library.take_discovered(discovered);
+        for (const LibraryTrack& t : discovered) {
+            add_track(t.path, t.title, t.artist, t.album, t.duration_ms, t.mtime);
+        }
+
+        player.update();
+
+        if (show_queue && queue.version() != queue_rows_version) {
+            queue_rows_version = queue.version();
+            queue_rows.clear();
+            queue_ids.clear();
+            for (PlayQueue::Id id = queue.first(); id != PlayQueue::NONE; id = queue.after(id)) {
+                queue_rows.emplace_back(queue.path(id));
+                queue_ids.push_back(id);
+            }
+        }
+
+        if (searching && search.take_results(search_matches, matched_query)) {
+            search_version++;
+            search_list.select(0);
+        }
+
+        bool filtered = !show_queue && searching && !search_query.empty();
+        ListRows rows = show_queue ? ListRows{queue_rows} : filtered ? ListRows{files, &search_matches} : ListRows{files};
+        ListView& view = show_queue ? queue_list : filtered ? search_list : list;
+        view.set_count(rows.size());
+        view.set_height(screen.list_height());
+        if (view.handle_key(ch)) ch = ERR;
+        size_t selected_item = view.selected();
+
+        // Keep the rows around the cursor warm so scrolling finds them parsed
+        for (size_t i = selected_item > 5 ? selected_item - 5 : 0;
+             i < std::min(rows.size(), selected_item + 6); ++i) {
+            meta_cache.prefetch(rows[i].native());
+        }
+
+        // Capture this frame's state; the screen repaints only what differs.
+        // The frame is reused, so a frame where nothing new happened
+        // allocates nothing.
+        char line[128];
+        if (show_queue) {
+            static const char* const REPEAT_NAMES[] = {"", "  [repeat all]", "  [repeat one]"};
+            snprintf(line, sizeof(line), "Queue: %zu tracks%s%s", queue.size(),
+                     queue.shuffle() ? "  [shuffle]" : "", REPEAT_NAMES[static_cast<int>(queue.repeat())]);
+            frame.header.assign(line);
+            frame.list_version = queue_rows_version * 2 + 1;
+            frame.marked = SIZE_MAX;
+            for (size_t i = 0; i < queue_ids.size(); ++i) {
+                if (queue_ids[i] == queue.current()) frame.marked = i;
+            }
+        } else if (searching) {
+            frame.header.assign("Search: ").append(search_query).append("_");
+            frame.list_version = 0;
+            frame.marked = SIZE_MAX;
+            if (filtered) {
+                if (matched_query == search_query) {
+                    snprintf(line, sizeof(line), "  (%zu matches)", search_matches.size());
+                    frame.header.append(line);
+                } else {
+                    frame.header.append("  (searching...)");
+                }
+                frame.list_version = search_version * 2 + 2;
+            }
+        } else {
+            frame.header.assign("Music in: ").append(music_directory);
+            frame.list_version = 0;
+            frame.marked = SIZE_MAX;
+            if (library.rescanned()) {
+                snprintf(line, sizeof(line),
+                         library.scanning() ? "  [scanning: %zu files, %.0f files/s]"
+                                            : "  [indexed %zu files, %.0f files/s]",
+                         library.files_scanned(), library.files_per_second());
+                frame.header.append(line);
+            }
+        }
+        frame.selected = selected_item;
+        frame.list_top = view.top();
+
+        if (is_playing && !player.playing().empty()) {
+            describe_playback(frame, meta_cache.lookup(player.playing()));
+        } else {
+            frame.info[0].assign("Now Playing:");
+            frame.info[1].assign("No song playing.");
+            frame.info[2].assign(show_queue ? "Enter plays, d removes, [ ] move, s shuffle, r repeat."
+                                            : "Enter plays from here, e/E to queue, / to search.");
+            frame.info[3].clear();
+            frame.art_meta.reset();
+            frame.show_progress = false;
+            frame.status.clear();
+
+            // Show ASCII art for selected song even when not playing
+            if (selected_item < rows.size()) {
+                auto meta = meta_cache.lookup(rows[selected_item].native());
+                if (meta) {
+                    if (meta->duration_seconds > 0) {
+                        snprintf(line, sizeof(line), "  (%02d:%02d)",
+                                 meta->duration_seconds / 60, meta->duration_seconds % 60);
+                        frame.info[2].append(line);
+                    }
+                    frame.art_meta = std::move(meta);
+                }
+            }
+        }
+
+        if (show_telemetry) {
+            telemetry_overlay(g_engine.telemetry().snapshot(), g_engine.sample_rate(), frame.telemetry);
+        } else {
+            frame.telemetry.clear();
+        }
+
+        frame.show_spectrum = show_spectrum && !show_telemetry && screen.spectrum_bar_rows() > 0;
+        if (frame.show_spectrum != analyzer.running()) {
+            if (frame.show_spectrum) {
+                analyzer.start();
+            } else {
+                analyzer.stop();
+            }
+        }
+        if (frame.show_spectrum) {
+            analyzer.set_bands(screen.spectrum_columns());
+            analyzer.take(spectrum);
+            spectrum_panel(spectrum, screen.spectrum_bar_rows(), screen.meter_width(), frame);
+        }
+
+        screen.render(frame, rows);
+
+        // Keys below change state after this frame was drawn
+        bool handled = (ch != ERR);
+
+        // While searching, keys edit the query instead of their usual jobs
+        if (searching && !show_queue) {
+            bool edited = false;
+            if (ch == 27) { // Leave the search, keeping the library cursor
+                searching = false;
+                search_query.clear();
+                search.submit("");
+                ch = ERR;
+            } else if (ch == 10) {
+                if (filtered && selected_item < rows.size()) {
+                    size_t index = rows.source(selected_item);
+                    play_library_from(index);
+                    list.select(index);
+                    searching = false;
+                    search_query.clear();
+                    search.submit("");
+                }
+                ch = ERR;
+            } else if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
+                // Drop a whole UTF-8 sequence
+                while (!search_query.empty() && (search_query.back() & 0xC0) == 0x80) search_query.pop_back();
+                if (!search_query.empty()) search_query.pop_back();
+                edited = true;
+            } else if ((ch >= 32 && ch < 127) || (ch >= 128 && ch < 256)) {
+                search_query += static_cast<char>(ch);
+                edited = true;
+            }
+            if (edited) {
+                search.submit(search_query);
+                ch = ERR;
+            }
+        }
+        
+        switch(ch) {
+            case 10: // Enter key
+                if (show_queue && selected_item < queue_ids.size()) {
+                    player.play(queue_ids[selected_item]);
+                } else if (!show_queue && selected_item < rows.size()) {
+                    play_library_from(rows.source(selected_item));
+                }
+                break;
+            case '/': // Filter the library
+                if (!show_queue) searching = true;
+                break;
+            case '\t': // Switch between the library and the queue
+                show_queue = !show_queue;
+                if (show_queue) queue_rows_version = ~uint64_t(0);
+                break;
+            case 'e': // Enqueue at the end
+            case 'E': // Play next
+                if (!show_queue && selected_item < files.size()) {
+                    if (ch == 'e') {
+                        queue.append(files[selected_item].string());
+                    } else {
+                        queue.insert_after(queue.current(), files[selected_item].string());
+                    }
+                }
+                break;
+            case 'd': // Remove from the queue
+            case KEY_DC:
+                if (show_queue && selected_item < queue_ids.size()) {
+                    queue.remove(queue_ids[selected_item]);
+                }
+                break;
+            case '[': // Move up or down in the queue
+                if (show_queue && selected_item > 0 && selected_item < queue_ids.size()) {
+                    queue.move_after(queue_ids[selected_item],
+                                     selected_item >= 2 ? queue_ids[selected_item - 2] : PlayQueue::NONE);
+                    queue_list.select(selected_item - 1);
+                }
+                break;
+            case ']':
+                if (show_queue && selected_item + 1 < queue_ids.size()) {
+                    queue.move_after(queue_ids[selected_item], queue_ids[selected_item + 1]);
+                    queue_list.select(selected_item + 1);
+                }
+                break;
+            case 'n':
+                player.next();
+                break;
+            case 'p':
+                player.prev();
+                break;
+            case 's':
+                queue.set_shuffle(!queue.shuffle());
+                break;
+            case 'r': // Repeat off, all, one
+                queue.set_repeat(static_cast<RepeatMode>((static_cast<int>(queue.repeat()) + 1) % 3));
+                break;
+            case ' ': // Space key to pause/resume
+                if (is_playing) {
+                    is_paused = !is_paused;
+                }
+                break;
+            case 't': // Toggle the telemetry overlay; recording runs only while shown
+                show_telemetry = !show_telemetry;
+                if (show_telemetry) {
+                    g_engine.telemetry().acquire();
+                } else {
+                    g_engine.telemetry().release();
+                }
+                break;
+            case 'v': // Spectrum and peak meters in place of the art
+                show_spectrum = !show_spectrum;
+                break;
+            case KEY_LEFT:
+            case KEY_RIGHT:
+                if (is_playing && g_engine.sample_rate() > 0) {
+                    sf_count_t step = static_cast<sf_count_t>(SEEK_STEP_SECONDS) * g_engine.sample_rate();
+                    g_engine.seek(std::max<sf_count_t>(0, current_frame + (ch == KEY_RIGHT ? step : -step)));
+                }
+                break;
+            default:
+                // 0-9 jump to that tenth of the track
+                if (ch >= '0' && ch <= '9' && is_playing && total_frames > 0) {
+                    g_engine.seek(total_frames * (ch - '0') / 10);
+                }
+                break;
+        }
+
+        // Draw the change a key made before sleeping again
+        ch = getch();
+        if (handled) continue;
+
+        // Sleep until a key, an engine event, new metadata or a resize.
+        // The progress tick only runs while something on screen moves.
+        if (ch == ERR) {
+            bool animating = (is_playing && !is_paused) || library.scanning() || show_telemetry;
+            g_events.set_tick(animating ? PROGRESS_TICK_MS : 0);
+            g_events.wait();
+            ch = getch();
+        }
+    }
+    g_events.set_tick(0);
+    if (show_telemetry) g_engine.telemetry().release();
+    analyzer.stop();
+
+    // Save where playback stands, then stop; the engine itself lives until
+    // main returns
+    player.save();
+    StopAudio();
+}
+
+int prompt_mode_selection() {
+    int highlight = 0;
+    const char* choices[] = {"Offline Library", "Online (YouTube)"};
+    
+    while(true) {
+        clear();
+        mvprintw(LINES / 2 - 2, (COLS - 20) / 2, "Select a mode:");
+        for(int i = 0; i < 2; ++i) {
+            if (i == highlight) attron(A_REVERSE);
+            mvprintw(LINES / 2 + i, (COLS - strlen(choices[i])) / 2, "%s", choices[i]);
+            if (i == highlight) attroff(A_REVERSE);
+        }
+        refresh();
+
+        int ch = wait_key();
+        switch(ch) {
+            case KEY_UP:
+            case KEY_DOWN:
+                highlight = !highlight;
+                break;
+            case 10: // Enter
+                return highlight;
+        }
+    }
+}
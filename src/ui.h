@@ -0,0 +1,62 @@
+#pragma once
+// ncurses screens: mode menu, file browser, playback and online mode
+
+#include "common.h"
+#include "library.h"
+#include "engine.h"
+#include "visualizer.h"
+
+// The main loop for online mode
+void run_online_mode();
+
+// File browser to select a directory
+std::string run_file_browser(const std::string& start_path);
+
+// Draw covers as colour half-blocks where the terminal allows it
+// (UWU_ART=ascii forces the character ramp)
+extern bool art_color_enabled;
+
+// --- Playback Screen ---
+
+// Everything the offline player shows, captured once per frame
+struct PlaybackFrame {
+    std::string header;
+    size_t selected = 0;
+    size_t list_top = 0;
+    uint64_t list_version = 0; // any change repaints every list row
+    size_t marked = SIZE_MAX;  // row drawn bold (the playing queue entry)
+    std::array<std::string, 4> info;
+    std::shared_ptr<const TrackMeta> art_meta;
+    bool show_progress = false;
+    int percent = 0;
+    long current_seconds = 0;
+    long total_seconds = 0;
+    uint64_t underruns = 0;
+    int dsp_permille = 0; // format conversion cost, per mille of real time
+    std::vector<std::string> telemetry; // replaces the art while shown
+    // Spectrum in place of the art: bar heights in eighths of a row, then
+    // the L/R peak meters as filled cells and whole dBFS
+    bool show_spectrum = false;
+    std::vector<uint16_t> spectrum;
+    std::array<int, 2> meter_cells{};
+    std::array<int, 2> meter_db{};
+    std::string status;
+};
+
+// Fill the Now Playing lines, progress and key hint for the playing track.
+// Strings are assigned in place, so a frame that changes nothing
+// allocates nothing.
+void describe_playback(PlaybackFrame& frame, std::shared_ptr<const TrackMeta> meta);
+
+// The art panel's telemetry text, overwriting lines in place
+void telemetry_overlay(const AudioTelemetry::Snapshot& s, int rate, std::vector<std::string>& lines);
+
+// Scale an analyzer frame to the art panel: bar_rows of bars above the
+// meters, meters meter_width cells wide
+void spectrum_panel(const SpectrumFrame& s, int bar_rows, int meter_width, PlaybackFrame& frame);
+
+// TUI function for the playback screen
+void run_playback_tui(const std::string& music_directory);
+
+// A new function to ask the user for the mode
+int prompt_mode_selection();
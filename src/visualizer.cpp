@@ -0,0 +1,227 @@
+#include "visualizer.h"
+
+int visualizer_fps = 30;
+
+// --- Spectrum Analyzer ---
+
+// One radix-2 stage over a span: a = x[j], b = x[j + m] * w[j], then
+// x[j] = a + b and x[j + m] = a - b, for j in [0, m)
+static void butterflies(float* a_re, float* a_im, float* b_re, float* b_im,
+                        const float* w_re, const float* w_im, size_t m) {
+    size_t j = 0;
+#if defined(__AVX__)
+    for (; j + 8 <= m; j += 8) {
+        __m256 xr = _mm256_loadu_ps(b_re + j), xi = _mm256_loadu_ps(b_im + j);
+        __m256 cr = _mm256_loadu_ps(w_re + j), ci = _mm256_loadu_ps(w_im + j);
+        __m256 tr = _mm256_sub_ps(_mm256_mul_ps(xr, cr), _mm256_mul_ps(xi, ci));
+        __m256 ti = _mm256_add_ps(_mm256_mul_ps(xr, ci), _mm256_mul_ps(xi, cr));
+        __m256 yr = _mm256_loadu_ps(a_re + j), yi = _mm256_loadu_ps(a_im + j);
+        _mm256_storeu_ps(a_re + j, _mm256_add_ps(yr, tr));
+        _mm256_storeu_ps(a_im + j, _mm256_add_ps(yi, ti));
+        _mm256_storeu_ps(b_re + j, _mm256_sub_ps(yr, tr));
+        _mm256_storeu_ps(b_im + j, _mm256_sub_ps(yi, ti));
+    }
+#elif defined(__SSE__)
+    for (; j + 4 <= m; j += 4) {
+        __m128 xr = _mm_loadu_ps(b_re + j), xi = _mm_loadu_ps(b_im + j);
+        __m128 cr = _mm_loadu_ps(w_re + j), ci = _mm_loadu_ps(w_im + j);
+        __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+        __m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+        __m128 yr = _mm_loadu_ps(a_re + j), yi = _mm_loadu_ps(a_im + j);
+        _mm_storeu_ps(a_re + j, _mm_add_ps(yr, tr));
+        _mm_storeu_ps(a_im + j, _mm_add_ps(yi, ti));
+        _mm_storeu_ps(b_re + j, _mm_sub_ps(yr, tr));
+        _mm_storeu_ps(b_im + j, _mm_sub_ps(yi, ti));
+    }
+#elif defined(__ARM_NEON)
+    for (; j + 4 <= m; j += 4) {
+        float32x4_t xr = vld1q_f32(b_re + j), xi = vld1q_f32(b_im + j);
+        float32x4_t cr = vld1q_f32(w_re + j), ci = vld1q_f32(w_im + j);
+        float32x4_t tr = vmlsq_f32(vmulq_f32(xr, cr), xi, ci);
+        float32x4_t ti = vmlaq_f32(vmulq_f32(xr, ci), xi, cr);
+        float32x4_t yr = vld1q_f32(a_re + j), yi = vld1q_f32(a_im + j);
+        vst1q_f32(a_re + j, vaddq_f32(yr, tr));
+        vst1q_f32(a_im + j, vaddq_f32(yi, ti));
+        vst1q_f32(b_re + j, vsubq_f32(yr, tr));
+        vst1q_f32(b_im + j, vsubq_f32(yi, ti));
+    }
+#endif
+    for (; j < m; ++j) {
+        float tr = b_re[j] * w_re[j] - b_im[j] * w_im[j];
+        float ti = b_re[j] * w_im[j] + b_im[j] * w_re[j];
+        b_re[j] = a_re[j] - tr;
+        b_im[j] = a_im[j] - ti;
+        a_re[j] += tr;
+        a_im[j] += ti;
+    }
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer(PlaybackEngine& engine, std::function<void()> on_frame)
+    : engine(engine), on_frame(std::move(on_frame)) {
+    const size_t n = SPECTRUM_FFT_SIZE;
+    hann.resize(n);
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        hann[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * M_PI * i / n));
+        sum += hann[i];
+    }
+    power_scale = static_cast<float>(4.0 / (sum * sum));
+
+    int bits = 0;
+    while ((size_t(1) << bits) < n) bits++;
+    reversed.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; ++b) r |= ((i >> b) & 1u) << (bits - 1 - b);
+        reversed[i] = r;
+    }
+
+    twiddle_re.resize(n - 1);
+    twiddle_im.resize(n - 1);
+    for (size_t m = 1; m < n; m <<= 1) {
+        for (size_t j = 0; j < m; ++j) {
+            twiddle_re[m - 1 + j] = static_cast<float>(std::cos(M_PI * j / m));
+            twiddle_im[m - 1 + j] = static_cast<float>(-std::sin(M_PI * j / m));
+        }
+    }
+
+    re.resize(n);
+    im.resize(n);
+    window.resize(n * OutputTap::CHANNELS);
+}
+
+void SpectrumAnalyzer::start() {
+    if (running()) return;
+    engine.output_tap().acquire();
+    stopping = false;
+    thread = std::thread(&SpectrumAnalyzer::run, this);
+}
+
+void SpectrumAnalyzer::stop() {
+    if (!running()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+    engine.output_tap().release();
+}
+
+bool SpectrumAnalyzer::take(SpectrumFrame& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (published.sequence == out.sequence) return false;
+    out = published;
+    return true;
+}
+
+// Log-spaced band edges in FFT bins; the lowest bands would be narrower
+// than a bin, so each band gets at least one. Returns true if they changed.
+bool SpectrumAnalyzer::configure_bands(size_t count, int rate) {
+    if (count == working.bands.size() && rate == band_rate) return false;
+    const size_t n = SPECTRUM_FFT_SIZE;
+    const uint32_t top_bin = static_cast<uint32_t>(n / 2);
+    float top = std::min(SPECTRUM_MAX_HZ, rate * 0.5f);
+
+    band_edges.resize(count + 1);
+    for (size_t i = 0; i <= count; ++i) {
+        float hz = SPECTRUM_MIN_HZ * std::pow(top / SPECTRUM_MIN_HZ, static_cast<float>(i) / count);
+        band_edges[i] = std::clamp<uint32_t>(static_cast<uint32_t>(std::lround(hz * n / rate)), 1, top_bin);
+    }
+    for (size_t i = 1; i <= count; ++i) {
+        band_edges[i] = std::min(top_bin + 1, std::max(band_edges[i], band_edges[i - 1] + 1));
+    }
+    working.bands.assign(count, 0.0f);
+    band_rate = rate;
+    return true;
+}
+
+void SpectrumAnalyzer::transform() {
+    const size_t n = SPECTRUM_FFT_SIZE;
+    for (size_t m = 1; m < n; m <<= 1) {
+        const float* w_re = &twiddle_re[m - 1];
+        const float* w_im = &twiddle_im[m - 1];
+        for (size_t k = 0; k < n; k += 2 * m) {
+            butterflies(&re[k], &im[k], &re[k + m], &im[k + m], w_re, w_im, m);
+        }
+    }
+}
+
+bool SpectrumAnalyzer::analyze(const float* frames, size_t fresh, int rate, float seconds) {
+    const size_t n = SPECTRUM_FFT_SIZE;
+    const int channels = OutputTap::CHANNELS;
+    bool changed = configure_bands(band_count.load(std::memory_order_relaxed), rate);
+
+    for (size_t i = 0; i < n; ++i) {
+        float mid = 0.5f * (frames[i * channels] + frames[i * channels + 1]);
+        re[reversed[i]] = mid * hann[i];
+        im[reversed[i]] = 0.0f;
+    }
+    transform();
+
+    float fall = SPECTRUM_FALL_PER_SECOND * seconds;
+    for (size_t b = 0; b < working.bands.size(); ++b) {
+        float power = 0.0f;
+        for (uint32_t k = band_edges[b]; k < band_edges[b + 1] && k <= n / 2; ++k) {
+            power = std::max(power, re[k] * re[k] + im[k] * im[k]);
+        }
+        float db = 10.0f * std::log10(power * power_scale + 1e-12f);
+        float level = std::clamp((db - SPECTRUM_FLOOR_DB) / -SPECTRUM_FLOOR_DB, 0.0f, 1.0f);
+        float shown = std::max(level, working.bands[b] - fall);
+        shown = std::max(shown, 0.0f);
+        changed = changed || shown != working.bands[b];
+        working.bands[b] = shown;
+    }
+
+    fresh = std::min(fresh, n);
+    float meter_fall = METER_FALL_DB_PER_SECOND * seconds;
+    for (int c = 0; c < channels; ++c) {
+        float peak = 0.0f;
+        for (size_t i = n - fresh; i < n; ++i) peak = std::max(peak, std::fabs(frames[i * channels + c]));
+        float db = peak > 0.0f ? 20.0f * std::log10(peak) : SPECTRUM_FLOOR_DB;
+        float held = std::max({db, working.peak_db[c] - meter_fall, SPECTRUM_FLOOR_DB});
+        changed = changed || held != working.peak_db[c];
+        working.peak_db[c] = held;
+    }
+    return changed;
+}
+
+void SpectrumAnalyzer::run() {
+    auto period = std::chrono::microseconds(1000000 / std::clamp(visualizer_fps, 1, 120));
+    float seconds = std::chrono::duration<float>(period).count();
+    const OutputTap& tap = engine.output_tap();
+    uint64_t last_end = 0;
+    auto next = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // Catch up with an overrun instead of bursting
+        next = std::max(next + period, std::chrono::steady_clock::now());
+        if (cv.wait_until(lock, next, [this] { return stopping; })) return;
+        lock.unlock();
+
+        uint64_t end = tap.read_latest(window.data(), SPECTRUM_FFT_SIZE);
+        bool changed = false;
+        if (end != 0 || last_end == 0) {
+            // With no new output (stopped, or nothing pushed yet) the bars
+            // fall back as if fed silence
+            size_t fresh = static_cast<size_t>(std::min<uint64_t>(end - std::min(end, last_end), SPECTRUM_FFT_SIZE));
+            if (fresh == 0) std::fill(window.begin(), window.end(), 0.0f);
+            last_end = std::max(last_end, end);
+
+            int rate = engine.sample_rate();
+            if (rate <= 0) rate = band_rate > 0 ? band_rate : 48000;
+            changed = analyze(window.data(), fresh, rate, seconds);
+        }
+
+        lock.lock();
+        if (changed) {
+            published.bands = working.bands;
+            published.peak_db = working.peak_db;
+            published.sequence++;
+            lock.unlock();
+            if (on_frame) on_frame();
+            lock.lock();
+        }
+    }
+}
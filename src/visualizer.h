@@ -0,0 +1,93 @@
+#pragma once
+// Visualizer: spectrum bands and peak meters computed from the engine's
+// output tap on a thread of their own
+
+#include "common.h"
+#include "engine.h"
+
+// --- Spectrum Analyzer ---
+//
+// Reads the newest SPECTRUM_FFT_SIZE frames from the output tap a capped
+// number of times per second, Hann-windows their mid channel and runs a
+// radix-2 FFT whose butterflies use the same SIMD paths as the resampler.
+// Bands are spaced logarithmically; bars fall back slowly and the peak
+// meters hold and decay like a PPM. Nothing runs and the tap stays off
+// unless start() was called.
+
+const size_t SPECTRUM_FFT_SIZE = 2048;
+const float SPECTRUM_FLOOR_DB = -72.0f;
+const float SPECTRUM_MIN_HZ = 40.0f;
+const float SPECTRUM_MAX_HZ = 16000.0f;
+// Full height per second a bar may drop, and dB per second for the meters
+const float SPECTRUM_FALL_PER_SECOND = 1.5f;
+const float METER_FALL_DB_PER_SECOND = 24.0f;
+
+// Analyses per second (override with UWU_VIS_FPS)
+extern int visualizer_fps;
+
+struct SpectrumFrame {
+    std::vector<float> bands;   // 0 at the floor to 1 at full scale, low to high
+    std::array<float, 2> peak_db{SPECTRUM_FLOOR_DB, SPECTRUM_FLOOR_DB};
+    uint64_t sequence = 0;
+};
+
+class SpectrumAnalyzer {
+public:
+    // on_frame runs on the analysis thread whenever a changed frame lands
+    explicit SpectrumAnalyzer(PlaybackEngine& engine, std::function<void()> on_frame = {});
+    ~SpectrumAnalyzer() { stop(); }
+
+    SpectrumAnalyzer(const SpectrumAnalyzer&) = delete;
+    SpectrumAnalyzer& operator=(const SpectrumAnalyzer&) = delete;
+
+    // Turn the tap on and start analysing; stop() turns both off again
+    void start();
+    void stop();
+    bool running() const { return thread.joinable(); }
+
+    // Number of bars to produce (the width they are drawn at)
+    void set_bands(size_t count) { band_count = std::max<size_t>(1, count); }
+
+    // Copy out the newest frame if it is newer than `out`. No allocation
+    // once `out` has held a frame with as many bands.
+    bool take(SpectrumFrame& out);
+
+    // One analysis step without the thread or the tap (for the bench):
+    // `window` holds SPECTRUM_FFT_SIZE interleaved stereo frames and the
+    // newest `fresh` of them feed the meters. Returns false when the
+    // result equals the previous one.
+    bool analyze(const float* window, size_t fresh, int rate, float seconds);
+    const SpectrumFrame& current() const { return working; }
+
+private:
+    bool configure_bands(size_t count, int rate);
+    void transform();
+    void run();
+
+    PlaybackEngine& engine;
+    std::function<void()> on_frame;
+    std::atomic<size_t> band_count{32};
+
+    // FFT in split real/imaginary form, input loaded in bit-reversed order.
+    // Twiddles for the stage of half-size m start at offset m - 1.
+    std::vector<float> hann;
+    std::vector<uint32_t> reversed;
+    std::vector<float> twiddle_re;
+    std::vector<float> twiddle_im;
+    std::vector<float> re;
+    std::vector<float> im;
+
+    // Bin range per band, rebuilt when the width or the rate changes
+    std::vector<uint32_t> band_edges;
+    int band_rate = 0;
+    float power_scale = 1.0f; // full-scale sine to 0 dB
+
+    std::vector<float> window;
+    SpectrumFrame working;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    SpectrumFrame published;
+    std::thread thread;
+    bool stopping = false;
+};